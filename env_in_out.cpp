@@ -0,0 +1,318 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#include "pfmBagDef.hpp"
+
+
+double settings_version = 1.0;
+
+
+//  Read in the vertical datum information from the vertical_datums.txt resource file.
+
+uint8_t read_vertical_datums (OPTIONS *options)
+{
+  char string[256];
+  QString qstring;
+
+
+  options->v_datum_count = 0;
+
+  QFile vDataFile (":/icons/vertical_datums.txt");
+
+  if (!vDataFile.open (QIODevice::ReadOnly)) return (NVFalse);
+
+
+  while (vDataFile.readLine (string, sizeof (string)) > 0)
+    {
+      qstring = QString (string);
+      options->v_datums[options->v_datum_count].active = (uint8_t) (qstring.section (':', 0, 0).toInt ());
+      options->v_datums[options->v_datum_count].abbrev = qstring.section (':', 1, 1);
+      options->v_datums[options->v_datum_count].name = qstring.section (':', 2, 2).simplified ();
+
+      options->v_datum_count++;
+    }
+
+  vDataFile.close ();
+
+
+  return (NVTrue);
+}
+
+
+
+//  Get the users defaults.
+
+void envin (OPTIONS *options)
+{
+  //  We need to get the font from the global settings.
+
+#ifdef NVWIN3X
+  QString ini_file2 = QString (getenv ("USERPROFILE")) + "/ABE.config/" + "globalABE.ini";
+#else
+  QString ini_file2 = QString (getenv ("HOME")) + "/ABE.config/" + "globalABE.ini";
+#endif
+
+  //  Only if we're running the wizard (there is no font in batch mode).
+
+  if (qobject_cast<QApplication *> (QCoreApplication::instance ()))
+    {
+      options->font = QApplication::font ();
+
+      QSettings settings2 (ini_file2, QSettings::IniFormat);
+      settings2.beginGroup ("globalABE");
+
+
+      QString defaultFont = options->font.toString ();
+      QString fontString = settings2.value (QString ("ABE map GUI font"), defaultFont).toString ();
+      options->font.fromString (fontString);
+
+
+      settings2.endGroup ();
+    }
+
+
+  double saved_version = 2.0;
+
+
+  // Set defaults so that if keys don't exist the parameters are defined
+
+  options->surface = CUBE_SURFACE;
+  options->uncertainty = TPE_UNCERT;
+  options->enhanced = NVTrue;
+  options->units = 0;
+  options->elev_off = 0.0;
+  options->depth_cor = 0;
+  options->v_datum = 53;
+  options->non_radius = 5.0;
+  options->source = QString ("Naval Oceanographic Office");
+  options->classification = 0;
+  options->authority = 0;
+  options->distStatement = QString ("Approved for public release; distribution is unlimited.");
+  options->pi_name = "";
+  options->pi_title = "";
+  options->poc_name = "";
+  options->input_dir = ".";
+  options->output_dir = ".";
+  options->area_dir = ".";
+  options->sep_dir = ".";
+  options->pfm_wkt = "";
+  options->bag_wkt = "";
+  options->window_x = 0;
+  options->window_y = 0;
+  options->window_width = 900;
+  options->window_height = 500;
+  options->threads = 0;
+  options->weight_engine = GATHER_WEIGHTS;
+  options->approx_error = 0.0;
+  options->grid_engine = GATHER_GRID;
+  options->depth_cache = 64;
+  options->prefetch = 2;
+  options->cube_fast = NVFalse;
+  options->file_hints = NVFalse;
+
+
+#ifdef NVWIN3X
+  QString ini_file = QString (getenv ("USERPROFILE")) + "/ABE.config/pfmBag.ini";
+#else
+  QString ini_file = QString (getenv ("HOME")) + "/ABE.config/pfmBag.ini";
+#endif
+
+
+  QSettings settings (ini_file, QSettings::IniFormat);
+
+  settings.beginGroup (QString ("pfmBag"));
+
+  saved_version = settings.value (QString ("settings version"), saved_version).toDouble ();
+
+
+  //  If the settings version has changed we need to leave the values at the new defaults since they may have changed.
+
+  if (settings_version != saved_version) return;
+
+
+  options->surface = settings.value (QString ("surface"), options->surface).toInt ();
+
+  options->uncertainty = settings.value (QString ("uncertainty"), options->uncertainty).toInt ();
+
+  options->enhanced = settings.value (QString ("enhanced surface flag"), options->enhanced).toBool ();
+
+  options->units = settings.value (QString ("units"), options->units).toInt ();
+
+  options->elev_off = settings.value (QString ("elevation offset"), options->elev_off).toFloat ();
+
+  options->depth_cor = settings.value (QString ("depth correction"), options->depth_cor).toInt ();
+
+  options->v_datum = settings.value (QString ("vertical datum"), options->v_datum).toInt ();
+
+  options->non_radius = settings.value (QString ("non-pfmFeature radius"), options->non_radius).toFloat ();
+
+
+  options->source = settings.value (QString ("data source"), options->source).toString ();
+
+  options->classification = settings.value (QString ("classification"), options->classification).toInt ();
+
+  options->authority = settings.value (QString ("declassification authority"), options->authority).toInt ();
+
+
+  options->distStatement = settings.value (QString ("distribution statement"), options->distStatement).toString ();
+
+
+  options->pi_name = settings.value (QString ("PI name"), options->pi_name).toString ();
+
+  options->pi_title = settings.value (QString ("PI title"), options->pi_title).toString ();
+
+  options->poc_name = settings.value (QString ("POC name"), options->poc_name).toString ();
+
+  options->pfm_wkt = settings.value (QString ("PFM WKT"), options->pfm_wkt).toString ();
+  options->bag_wkt = settings.value (QString ("BAG WKT"), options->bag_wkt).toString ();
+
+  options->input_dir = settings.value (QString ("input directory"), options->input_dir).toString ();
+  options->output_dir = settings.value (QString ("output directory"), options->output_dir).toString ();
+  options->area_dir = settings.value (QString ("area directory"), options->area_dir).toString ();
+  options->sep_dir = settings.value (QString ("separation directory"), options->sep_dir).toString ();
+
+  options->threads = settings.value (QString ("gridding threads"), options->threads).toInt ();
+
+  options->weight_engine = settings.value (QString ("weight engine"), options->weight_engine).toInt ();
+
+  options->approx_error = settings.value (QString ("approximate transform error"), options->approx_error).toDouble ();
+
+  options->grid_engine = settings.value (QString ("gridding engine"), options->grid_engine).toInt ();
+
+  options->depth_cache = settings.value (QString ("depth cache size"), options->depth_cache).toInt ();
+
+  options->prefetch = settings.value (QString ("prefetch rows"), options->prefetch).toInt ();
+
+  options->cube_fast = settings.value (QString ("cube fast flag"), options->cube_fast).toBool ();
+
+  options->file_hints = settings.value (QString ("file hints flag"), options->file_hints).toBool ();
+
+  options->window_width = settings.value (QString ("width"), options->window_width).toInt ();
+  options->window_height = settings.value (QString ("height"), options->window_height).toInt ();
+  options->window_x = settings.value (QString ("x position"), options->window_x).toInt ();
+  options->window_y = settings.value (QString ("y position"), options->window_y).toInt ();
+
+  settings.endGroup ();
+}
+
+
+
+
+//  Save the users defaults.
+
+void envout (OPTIONS *options)
+{
+#ifdef NVWIN3X
+  QString ini_file = QString (getenv ("USERPROFILE")) + "/ABE.config/pfmBag.ini";
+#else
+  QString ini_file = QString (getenv ("HOME")) + "/ABE.config/pfmBag.ini";
+#endif
+
+
+  QSettings settings (ini_file, QSettings::IniFormat);
+
+  settings.beginGroup (QString ("pfmBag"));
+
+
+  settings.setValue (QString ("settings version"), settings_version);
+
+
+  settings.setValue (QString ("surface"), options->surface);
+
+  settings.setValue (QString ("uncertainty"), options->uncertainty);
+
+  settings.setValue (QString ("enhanced surface flag"), options->enhanced);
+
+  settings.setValue (QString ("units"), options->units);
+
+  settings.setValue (QString ("elevation offset"), options->elev_off);
+
+  settings.setValue (QString ("depth correction"), options->depth_cor);
+
+  settings.setValue (QString ("vertical datum"), options->v_datum);
+
+  settings.setValue (QString ("non-pfmFeature radius"), options->non_radius);
+
+
+  settings.setValue (QString ("data source"), options->source);
+
+  settings.setValue (QString ("classification"), options->classification);
+
+  settings.setValue (QString ("declassification authority"), options->authority);
+
+
+  settings.setValue (QString ("distribution statement"), options->distStatement);
+
+
+  settings.setValue (QString ("PI name"), options->pi_name);
+
+  settings.setValue (QString ("PI title"), options->pi_title);
+
+  settings.setValue (QString ("POC name"), options->poc_name);
+
+  settings.setValue (QString ("PFM WKT"), options->pfm_wkt);
+  settings.setValue (QString ("BAG WKT"), options->bag_wkt);
+
+  settings.setValue (QString ("input directory"), options->input_dir);
+  settings.setValue (QString ("output directory"), options->output_dir);
+  settings.setValue (QString ("area directory"), options->area_dir);
+  settings.setValue (QString ("separation directory"), options->sep_dir);
+
+  settings.setValue (QString ("gridding threads"), options->threads);
+
+  settings.setValue (QString ("weight engine"), options->weight_engine);
+
+  settings.setValue (QString ("approximate transform error"), options->approx_error);
+
+  settings.setValue (QString ("gridding engine"), options->grid_engine);
+
+  settings.setValue (QString ("depth cache size"), options->depth_cache);
+
+  settings.setValue (QString ("prefetch rows"), options->prefetch);
+
+  settings.setValue (QString ("cube fast flag"), options->cube_fast);
+
+  settings.setValue (QString ("file hints flag"), options->file_hints);
+
+  settings.setValue (QString ("width"), options->window_width);
+  settings.setValue (QString ("height"), options->window_height);
+  settings.setValue (QString ("x position"), options->window_x);
+  settings.setValue (QString ("y position"), options->window_y);
+
+  settings.endGroup ();
+}
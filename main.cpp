@@ -50,11 +50,24 @@
 \***************************************************************************/
 
 #include "pfmBag.hpp"
+#include "pfmBagBatch.hpp"
 #include "version.hpp"
 
 
 int main (int argc, char **argv)
 {
+  //  If the first argument is a long option (e.g. --pfm) we run in batch mode.  No wizard and no X server needed.
+
+  if (argc > 1 && (!strncmp (argv[1], "--", 2) || !strcmp (argv[1], "-h")))
+    {
+      QCoreApplication a (argc, argv);
+
+      pfmBagBatch batch (argc, argv);
+
+      return (batch.run ());
+    }
+
+
   QApplication a (argc, argv);
 
   QTranslator translator;
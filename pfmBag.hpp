@@ -45,6 +45,7 @@
 #include "datumPage.hpp"
 #include "classPage.hpp"
 #include "runPage.hpp"
+#include "pfmBagThread.hpp"
 
 
 class pfmBag : public QWizard
@@ -63,22 +64,21 @@ protected:
   void initializePage (int id);
   void cleanupPage (int id);
 
-  void envin (OPTIONS *options);
-  void envout (OPTIONS *options);
-
 
   OPTIONS          options;
 
   RUN_PROGRESS     progress;
 
-  projPJ           pfm_proj, bag_proj;
-
-  uint8_t          io_crs_equal;
-
   datumPage        *dPage;
 
   surfacePage      *sPage;
 
+  runPage          *rPage;
+
+  pfmBagThread     *thread;
+
+  QString          thread_error;           //  Errors from the conversion thread, shown when it finishes
+
   QListWidget      *checkList;
 
   QString          output_file_name, area_file_name, sep_file_name;
@@ -88,6 +88,9 @@ protected slots:
 
   void slotHelpClicked ();
   void slotCustomButtonClicked (int id);
+  void slotThreadWarning (QString msg);
+  void slotThreadError (QString msg);
+  void slotThreadFinished ();
 
 };
 
@@ -23,8 +23,21 @@ HEADERS += classPage.hpp \
            datumPage.hpp \
            datumPageHelp.hpp \
            pfmBag.hpp \
+           pfmBagBatch.hpp \
            pfmBagDef.hpp \
+           pfmBagDepthCache.hpp \
+           pfmBagEngine.hpp \
+           pfmBagFileHints.hpp \
+           pfmBagGeoDistance.hpp \
+           pfmBagGridThread.hpp \
+           pfmBagHandlePool.hpp \
            pfmBagHelp.hpp \
+           pfmBagPrefetchThread.hpp \
+           pfmBagRemarks.hpp \
+           pfmBagSoundings.hpp \
+           pfmBagThread.hpp \
+           pfmBagWeightGrid.hpp \
+           pfmBagWeightThread.hpp \
            runPage.hpp \
            startPage.hpp \
            startPageHelp.hpp \
@@ -34,9 +47,24 @@ HEADERS += classPage.hpp \
            wktDialog.hpp
 SOURCES += classPage.cpp \
            datumPage.cpp \
+           env_in_out.cpp \
            main.cpp \
            pfmBag.cpp \
+           pfmBagBatch.cpp \
+           pfmBagDepthCache.cpp \
+           pfmBagEngine.cpp \
+           pfmBagFileHints.cpp \
+           pfmBagGeoDistance.cpp \
+           pfmBagGridThread.cpp \
+           pfmBagHandlePool.cpp \
+           pfmBagPrefetchThread.cpp \
+           pfmBagRemarks.cpp \
+           pfmBagSoundings.cpp \
+           pfmBagThread.cpp \
+           pfmBagWeightGrid.cpp \
+           pfmBagWeightThread.cpp \
            runPage.cpp \
+           set_convert_options.cpp \
            startPage.cpp \
            surfacePage.cpp \
            wktDialog.cpp
@@ -0,0 +1,814 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#include "pfmBagBatch.hpp"
+#include "version.hpp"
+
+
+//  Long option identifiers (there are no single character options other than -h).
+
+enum
+  {
+    PFM_OPT = 1000,
+    BAG_OPT,
+    SURFACE_OPT,
+    UNCERTAINTY_OPT,
+    BIN_OPT,
+    MINUTES_OPT,
+    ENHANCED_OPT,
+    NO_ENHANCED_OPT,
+    RADIUS_OPT,
+    PFM_WKT_OPT,
+    BAG_WKT_OPT,
+    AREA_OPT,
+    SEP_OPT,
+    ELEV_OFF_OPT,
+    DEPTH_COR_OPT,
+    V_DATUM_OPT,
+    SOURCE_OPT,
+    TITLE_OPT,
+    ABSTRACT_OPT,
+    PI_NAME_OPT,
+    PI_TITLE_OPT,
+    POC_NAME_OPT,
+    CLASSIFICATION_OPT,
+    AUTHORITY_OPT,
+    DECLASS_DATE_OPT,
+    DIST_STATEMENT_OPT,
+    THREADS_OPT,
+    WEIGHTS_OPT,
+    APPROX_ERROR_OPT,
+    GRIDDING_OPT,
+    DEPTH_CACHE_OPT,
+    PREFETCH_OPT,
+    CUBE_FAST_OPT,
+    NO_CUBE_FAST_OPT,
+    FILE_HINTS_OPT,
+    NO_FILE_HINTS_OPT
+  };
+
+
+
+pfmBagBatch::pfmBagBatch (int32_t ac, char **av)
+{
+  argc = ac;
+  argv = av;
+
+  strcpy (options.progname, argv[0]);
+
+  surface_set = uncertainty_set = mbin_set = gbin_set = help = NVFalse;
+
+  for (int32_t i = 0 ; i < 3 ; i++)
+    {
+      range_max[i] = 0;
+      percent[i] = -1;
+    }
+}
+
+
+
+pfmBagBatch::~pfmBagBatch ()
+{
+}
+
+
+
+void 
+pfmBagBatch::usage ()
+{
+  fprintf (stderr, "\n%s\n\n", VERSION);
+  fprintf (stderr, "Usage: %s --pfm PFM_FILE --bag BAG_FILE [OPTIONS]\n\n", options.progname);
+  fprintf (stderr, "Builds a BAG from a PFM without running the wizard.  Anything that isn't specified on the\n");
+  fprintf (stderr, "command line is taken from the pfmBag.ini defaults (i.e. whatever was used last in the wizard).\n\n");
+  fprintf (stderr, "Options:\n");
+  fprintf (stderr, "  --pfm FILE              Input PFM list file (required)\n");
+  fprintf (stderr, "  --bag FILE              Output BAG file (required, .bag will be appended if missing)\n");
+  fprintf (stderr, "  --surface TYPE          min, max, avg, or cube\n");
+  fprintf (stderr, "  --uncertainty TYPE      std, tpe, or fin (fin is only available for cube)\n");
+  fprintf (stderr, "  --bin SIZE              Bin size in meters (defaults to the PFM bin size)\n");
+  fprintf (stderr, "  --minutes SIZE          Bin size in minutes of latitude/longitude (instead of --bin)\n");
+  fprintf (stderr, "  --enhanced              Build the enhanced navigation surface using the PFM feature file\n");
+  fprintf (stderr, "  --no-enhanced           Don't build the enhanced navigation surface\n");
+  fprintf (stderr, "  --radius METERS         Search radius for non-pfmFeature features (enhanced surface)\n");
+  fprintf (stderr, "  --pfm-wkt WKT|FILE      PFM CRS (only used if the PFM header doesn't have WKT)\n");
+  fprintf (stderr, "  --bag-wkt WKT|FILE      BAG CRS\n");
+  fprintf (stderr, "  --area FILE             Area file (.ARE, .are, .afs, or .shp)\n");
+  fprintf (stderr, "  --sep FILE              Separation file (.ch2 or ASCII LAT,LONG,Z0,Z1)\n");
+  fprintf (stderr, "  --elev-off VALUE        Offset to be added to each elevation\n");
+  fprintf (stderr, "  --depth-cor N           0 - corrected, 1 - 1500 m/s, 2 - 4800 ft/s, 3 - 800 fm/s, 4 - mixed\n");
+  fprintf (stderr, "  --v-datum ABBREV|TEXT   Vertical datum abbreviation (e.g. MLLW) or any other text/VERT_CS WKT\n");
+  fprintf (stderr, "  --source TEXT           Data source\n");
+  fprintf (stderr, "  --title TEXT            Title (defaults to the BAG file name)\n");
+  fprintf (stderr, "  --abstract TEXT         Abstract (defaults to the BAG file name)\n");
+  fprintf (stderr, "  --pi-name TEXT          Principal investigator name\n");
+  fprintf (stderr, "  --pi-title TEXT         Principal investigator title\n");
+  fprintf (stderr, "  --poc-name TEXT         Point of contact name\n");
+  fprintf (stderr, "  --classification N      0 - Unclassified, 1 - Confidential, 2 - Secret, 3 - Top Secret\n");
+  fprintf (stderr, "  --authority N           Declassification authority (0 - N/A, 1 through 4 - OPNAVINSTS5513.5B)\n");
+  fprintf (stderr, "  --declass-date DATE     Declassification date (yyyy-MM-dd, defaults to 10 years from today)\n");
+  fprintf (stderr, "  --dist-statement TEXT   Distribution statement\n");
+  fprintf (stderr, "  --threads N             Number of gridding and weight threads (0 - one per processor, 1 - no threads)\n");
+  fprintf (stderr, "  --weights TYPE          Enhanced surface weight engine, gather (per cell) or splat (per feature)\n");
+  fprintf (stderr, "  --approx-error METERS   Allowed error for approximate UTM cell corner transforms (0 - exact)\n");
+  fprintf (stderr, "  --gridding TYPE         Gridding engine, gather (per BAG cell) or scatter (per PFM cell)\n");
+  fprintf (stderr, "  --depth-cache MB        Size of each gridding thread's PFM depth array cache (0 - no cache)\n");
+  fprintf (stderr, "  --prefetch ROWS         Number of BAG rows of PFM data to read ahead of each gridding thread (0 - none)\n");
+  fprintf (stderr, "  --cube-fast             CUBE surface sounding counts from the PFM bin records\n");
+  fprintf (stderr, "  --no-cube-fast          CUBE surface sounding counts from the soundings\n");
+  fprintf (stderr, "  --file-hints            Ask the kernel to read ahead the PFM bin and depth files\n");
+  fprintf (stderr, "  --no-file-hints         Let libpfm read the PFM files without hints\n");
+  fprintf (stderr, "  -h, --help              This message\n\n");
+  fflush (stderr);
+}
+
+
+
+//  If the argument is the name of an existing file we read the WKT from the file, otherwise the argument is the WKT.
+
+QString 
+pfmBagBatch::readWkt (QString arg)
+{
+  QFile file (arg);
+
+  if (!file.exists () || !file.open (QIODevice::ReadOnly)) return (arg);
+
+  QString wkt = QString (file.readAll ()).simplified ();
+
+  file.close ();
+
+  return (wkt);
+}
+
+
+
+//  If the WKT is a compound CRS strip the vertical section (just like datumPage does).  The WKT comes from the command
+//  line or a file so it can be any length, OGR gets a copy of the whole thing.
+
+QString 
+pfmBagBatch::stripVertical (QString wkt)
+{
+  OGRSpatialReference SRS;
+  QByteArray wkt_buf = wkt.toLatin1 ();
+  char *ppsz, *ptr_wkt = wkt_buf.data ();
+
+  if (SRS.importFromWkt (&ptr_wkt) == OGRERR_NONE)
+    {
+      if ((SRS.IsProjected () || SRS.IsGeographic ()) && SRS.IsCompound ())
+        {
+          SRS.StripVertical ();
+
+          SRS.exportToWkt (&ppsz);
+
+          wkt = QString (ppsz);
+
+          OGRFree (ppsz);
+        }
+    }
+
+  return (wkt);
+}
+
+
+
+uint8_t 
+pfmBagBatch::parseArguments ()
+{
+  static struct option long_options[] = {{"pfm", required_argument, 0, PFM_OPT},
+                                         {"bag", required_argument, 0, BAG_OPT},
+                                         {"surface", required_argument, 0, SURFACE_OPT},
+                                         {"uncertainty", required_argument, 0, UNCERTAINTY_OPT},
+                                         {"bin", required_argument, 0, BIN_OPT},
+                                         {"minutes", required_argument, 0, MINUTES_OPT},
+                                         {"enhanced", no_argument, 0, ENHANCED_OPT},
+                                         {"no-enhanced", no_argument, 0, NO_ENHANCED_OPT},
+                                         {"radius", required_argument, 0, RADIUS_OPT},
+                                         {"pfm-wkt", required_argument, 0, PFM_WKT_OPT},
+                                         {"bag-wkt", required_argument, 0, BAG_WKT_OPT},
+                                         {"area", required_argument, 0, AREA_OPT},
+                                         {"sep", required_argument, 0, SEP_OPT},
+                                         {"elev-off", required_argument, 0, ELEV_OFF_OPT},
+                                         {"depth-cor", required_argument, 0, DEPTH_COR_OPT},
+                                         {"v-datum", required_argument, 0, V_DATUM_OPT},
+                                         {"source", required_argument, 0, SOURCE_OPT},
+                                         {"title", required_argument, 0, TITLE_OPT},
+                                         {"abstract", required_argument, 0, ABSTRACT_OPT},
+                                         {"pi-name", required_argument, 0, PI_NAME_OPT},
+                                         {"pi-title", required_argument, 0, PI_TITLE_OPT},
+                                         {"poc-name", required_argument, 0, POC_NAME_OPT},
+                                         {"classification", required_argument, 0, CLASSIFICATION_OPT},
+                                         {"authority", required_argument, 0, AUTHORITY_OPT},
+                                         {"declass-date", required_argument, 0, DECLASS_DATE_OPT},
+                                         {"dist-statement", required_argument, 0, DIST_STATEMENT_OPT},
+                                         {"threads", required_argument, 0, THREADS_OPT},
+                                         {"weights", required_argument, 0, WEIGHTS_OPT},
+                                         {"approx-error", required_argument, 0, APPROX_ERROR_OPT},
+                                         {"gridding", required_argument, 0, GRIDDING_OPT},
+                                         {"depth-cache", required_argument, 0, DEPTH_CACHE_OPT},
+                                         {"prefetch", required_argument, 0, PREFETCH_OPT},
+                                         {"cube-fast", no_argument, 0, CUBE_FAST_OPT},
+                                         {"no-cube-fast", no_argument, 0, NO_CUBE_FAST_OPT},
+                                         {"file-hints", no_argument, 0, FILE_HINTS_OPT},
+                                         {"no-file-hints", no_argument, 0, NO_FILE_HINTS_OPT},
+                                         {"help", no_argument, 0, 'h'},
+                                         {0, no_argument, 0, 0}};
+  int32_t option_index = 0, c;
+  QString arg;
+
+
+  options.pfm_file_name = "";
+  output_file_name = area_file_name = sep_file_name = "";
+
+
+  while ((c = getopt_long (argc, argv, "h", long_options, &option_index)) != -1)
+    {
+      arg = QString (optarg);
+
+      switch (c)
+        {
+        case PFM_OPT:
+          options.pfm_file_name = arg;
+          break;
+
+        case BAG_OPT:
+          output_file_name = arg;
+          break;
+
+        case SURFACE_OPT:
+          surface_set = NVTrue;
+          if (!arg.compare ("min", Qt::CaseInsensitive))
+            {
+              options.surface = MIN_SURFACE;
+            }
+          else if (!arg.compare ("max", Qt::CaseInsensitive))
+            {
+              options.surface = MAX_SURFACE;
+            }
+          else if (!arg.compare ("avg", Qt::CaseInsensitive))
+            {
+              options.surface = AVG_SURFACE;
+            }
+          else if (!arg.compare ("cube", Qt::CaseInsensitive))
+            {
+              options.surface = CUBE_SURFACE;
+            }
+          else
+            {
+              errorMessage (tr ("Unknown surface type %1").arg (arg));
+              return (NVFalse);
+            }
+          break;
+
+        case UNCERTAINTY_OPT:
+          uncertainty_set = NVTrue;
+          if (!arg.compare ("std", Qt::CaseInsensitive))
+            {
+              options.uncertainty = STD_UNCERT;
+            }
+          else if (!arg.compare ("tpe", Qt::CaseInsensitive))
+            {
+              options.uncertainty = TPE_UNCERT;
+            }
+          else if (!arg.compare ("fin", Qt::CaseInsensitive))
+            {
+              options.uncertainty = FIN_UNCERT;
+            }
+          else
+            {
+              errorMessage (tr ("Unknown uncertainty type %1").arg (arg));
+              return (NVFalse);
+            }
+          break;
+
+        case BIN_OPT:
+          mbin_set = NVTrue;
+          options.mbin_size = arg.toDouble ();
+          break;
+
+        case MINUTES_OPT:
+          gbin_set = NVTrue;
+          options.gbin_size = arg.toDouble ();
+          break;
+
+        case ENHANCED_OPT:
+          options.enhanced = NVTrue;
+          break;
+
+        case NO_ENHANCED_OPT:
+          options.enhanced = NVFalse;
+          break;
+
+        case RADIUS_OPT:
+          options.non_radius = arg.toFloat ();
+          break;
+
+        case PFM_WKT_OPT:
+          options.pfm_wkt = readWkt (arg);
+          break;
+
+        case BAG_WKT_OPT:
+          options.bag_wkt = readWkt (arg);
+          break;
+
+        case AREA_OPT:
+          area_file_name = arg;
+          break;
+
+        case SEP_OPT:
+          sep_file_name = arg;
+          break;
+
+        case ELEV_OFF_OPT:
+          options.elev_off = arg.toFloat ();
+          break;
+
+        case DEPTH_COR_OPT:
+          options.depth_cor = arg.toInt ();
+          break;
+
+        case V_DATUM_OPT:
+          {
+            int32_t other = -1;
+
+            options.v_datum = -1;
+
+            for (int32_t i = 0 ; i < options.v_datum_count ; i++)
+              {
+                if (!arg.compare (options.v_datums[i].abbrev, Qt::CaseInsensitive)) options.v_datum = i;
+                if (options.v_datums[i].abbrev == "OTHER") other = i;
+              }
+
+
+            //  Anything that isn't one of the abbreviations is treated like the "OTHER" entry in the datum page.
+
+            if (options.v_datum < 0 && other >= 0)
+              {
+                options.v_datum = other;
+                options.v_datums[other].name = arg;
+              }
+          }
+          break;
+
+        case SOURCE_OPT:
+          options.source = arg;
+          break;
+
+        case TITLE_OPT:
+          options.title = arg;
+          break;
+
+        case ABSTRACT_OPT:
+          options.abstract = arg;
+          break;
+
+        case PI_NAME_OPT:
+          options.pi_name = arg;
+          break;
+
+        case PI_TITLE_OPT:
+          options.pi_title = arg;
+          break;
+
+        case POC_NAME_OPT:
+          options.poc_name = arg;
+          break;
+
+        case CLASSIFICATION_OPT:
+          options.classification = arg.toInt ();
+          break;
+
+        case AUTHORITY_OPT:
+          options.authority = arg.toInt ();
+          break;
+
+        case DECLASS_DATE_OPT:
+          options.declassDate = QDate::fromString (arg, "yyyy-MM-dd");
+          if (!options.declassDate.isValid ())
+            {
+              errorMessage (tr ("Declassification date %1 is not in yyyy-MM-dd format").arg (arg));
+              return (NVFalse);
+            }
+          break;
+
+        case DIST_STATEMENT_OPT:
+          options.distStatement = arg;
+          break;
+
+        case THREADS_OPT:
+          options.threads = arg.toInt ();
+          if (options.threads < 0)
+            {
+              errorMessage (tr ("Invalid number of threads %1").arg (arg));
+              return (NVFalse);
+            }
+          break;
+
+        case WEIGHTS_OPT:
+          if (!arg.compare ("gather", Qt::CaseInsensitive))
+            {
+              options.weight_engine = GATHER_WEIGHTS;
+            }
+          else if (!arg.compare ("splat", Qt::CaseInsensitive))
+            {
+              options.weight_engine = SPLAT_WEIGHTS;
+            }
+          else
+            {
+              errorMessage (tr ("Unknown weight engine %1").arg (arg));
+              return (NVFalse);
+            }
+          break;
+
+        case APPROX_ERROR_OPT:
+          options.approx_error = arg.toDouble ();
+          if (options.approx_error < 0.0)
+            {
+              errorMessage (tr ("Invalid approximate transform error %1").arg (arg));
+              return (NVFalse);
+            }
+          break;
+
+        case GRIDDING_OPT:
+          if (!arg.compare ("gather", Qt::CaseInsensitive))
+            {
+              options.grid_engine = GATHER_GRID;
+            }
+          else if (!arg.compare ("scatter", Qt::CaseInsensitive))
+            {
+              options.grid_engine = SCATTER_GRID;
+            }
+          else
+            {
+              errorMessage (tr ("Unknown gridding engine %1").arg (arg));
+              return (NVFalse);
+            }
+          break;
+
+        case DEPTH_CACHE_OPT:
+          options.depth_cache = arg.toInt ();
+          if (options.depth_cache < 0)
+            {
+              errorMessage (tr ("Invalid depth cache size %1").arg (arg));
+              return (NVFalse);
+            }
+          break;
+
+        case PREFETCH_OPT:
+          options.prefetch = arg.toInt ();
+          if (options.prefetch < 0)
+            {
+              errorMessage (tr ("Invalid number of prefetch rows %1").arg (arg));
+              return (NVFalse);
+            }
+          break;
+
+        case CUBE_FAST_OPT:
+          options.cube_fast = NVTrue;
+          break;
+
+        case NO_CUBE_FAST_OPT:
+          options.cube_fast = NVFalse;
+          break;
+
+        case FILE_HINTS_OPT:
+          options.file_hints = NVTrue;
+          break;
+
+        case NO_FILE_HINTS_OPT:
+          options.file_hints = NVFalse;
+          break;
+
+        case 'h':
+          usage ();
+          help = NVTrue;
+          return (NVFalse);
+
+        default:
+          usage ();
+          return (NVFalse);
+        }
+    }
+
+
+  if (optind < argc)
+    {
+      errorMessage (tr ("Unexpected argument %1").arg (QString (argv[optind])));
+      return (NVFalse);
+    }
+
+
+  if (options.pfm_file_name.isEmpty () || output_file_name.isEmpty ())
+    {
+      usage ();
+      return (NVFalse);
+    }
+
+
+  return (NVTrue);
+}
+
+
+
+//  Do the same checks and adjustments that the wizard pages do.
+
+uint8_t 
+pfmBagBatch::checkOptions ()
+{
+  PFM_OPEN_ARGS open_args;
+
+  strcpy (open_args.list_path, options.pfm_file_name.toLatin1 ());
+  open_args.checkpoint = 0;
+
+  int32_t pfm_handle = open_existing_pfm_file (&open_args);
+
+  if (pfm_handle < 0)
+    {
+      errorMessage (tr ("The file %1 is not a PFM structure or there was an error reading the file.\nThe error message returned was:\n\n%2").arg
+                    (options.pfm_file_name).arg (pfm_error_str (pfm_error)));
+      return (NVFalse);
+    }
+
+  close_pfm_file (pfm_handle);
+
+
+  //  The CUBE surface is only available if the PFM was CUBEd.
+
+  if (!strstr (open_args.head.average_filt_name, "CUBE"))
+    {
+      if (options.surface == CUBE_SURFACE)
+        {
+          if (surface_set)
+            {
+              errorMessage (tr ("The CUBE surface is not available in %1").arg (options.pfm_file_name));
+              return (NVFalse);
+            }
+
+          options.surface = AVG_SURFACE;
+        }
+
+      if (options.uncertainty == FIN_UNCERT)
+        {
+          if (uncertainty_set)
+            {
+              errorMessage (tr ("Final uncertainty is not available in %1").arg (options.pfm_file_name));
+              return (NVFalse);
+            }
+
+          options.uncertainty = STD_UNCERT;
+        }
+    }
+
+
+  //  If we're running a CUBE surface we can't change the bin size or select the uncertainty type.
+
+  if (options.surface == CUBE_SURFACE)
+    {
+      if (mbin_set || gbin_set) warningMessage (tr ("The bin size can't be changed for a CUBE surface, using the PFM bin size"));
+      if (uncertainty_set && options.uncertainty != FIN_UNCERT)
+        warningMessage (tr ("The uncertainty type can't be changed for a CUBE surface, using final uncertainty"));
+
+      options.uncertainty = FIN_UNCERT;
+      options.mbin_size = open_args.head.bin_size_xy;
+      options.gbin_size = 0.0;
+    }
+  else
+    {
+      if (options.uncertainty == FIN_UNCERT)
+        {
+          if (uncertainty_set)
+            {
+              errorMessage (tr ("Final uncertainty is only available for the CUBE surface"));
+              return (NVFalse);
+            }
+
+          options.uncertainty = TPE_UNCERT;
+        }
+
+
+      //  Bin size defaults to the PFM bin size.  We don't ever want both gbin and mbin to be 0.0.
+
+      if (gbin_set && options.gbin_size > 0.0)
+        {
+          if (mbin_set && options.mbin_size > 0.0)
+            {
+              errorMessage (tr ("Only one of --bin and --minutes can be specified"));
+              return (NVFalse);
+            }
+
+          options.mbin_size = 0.0;
+        }
+      else
+        {
+          if (!mbin_set || options.mbin_size <= 0.0) options.mbin_size = open_args.head.bin_size_xy;
+          options.gbin_size = 0.0;
+        }
+    }
+
+
+  //  The enhanced surface needs a feature file, an average or CUBE surface, and a bin size in meters.
+
+  if (options.surface != CUBE_SURFACE && options.surface != AVG_SURFACE) options.enhanced = NVFalse;
+  if (!strcmp (open_args.target_path, "NONE")) options.enhanced = NVFalse;
+  if (options.mbin_size == 0.0) options.enhanced = NVFalse;
+
+
+  //  If the PFM has WKT in the header we use that (after stripping the vertical section).
+
+  QString pfm_wkt = stripVertical (QString (open_args.head.proj_data.wkt));
+
+  if (pfm_wkt.contains ("GEOGCS")) options.pfm_wkt = pfm_wkt;
+
+  if (!options.pfm_wkt.contains ("GEOGCS"))
+    {
+      errorMessage (tr ("You must specify a Coordinate Reference System for the input PFM file (--pfm-wkt)"));
+      return (NVFalse);
+    }
+
+  if (options.pfm_wkt.contains ("PROJCS"))
+    {
+      errorMessage (tr ("You cannot use a projected Coordinate Reference System for the input PFM!"));
+      return (NVFalse);
+    }
+
+
+  options.bag_wkt = stripVertical (options.bag_wkt);
+
+  if (!options.bag_wkt.contains ("GEOGCS"))
+    {
+      errorMessage (tr ("You must specify a Coordinate Reference System for the output BAG file (--bag-wkt)"));
+      return (NVFalse);
+    }
+
+
+  if (options.v_datum < 0 || options.v_datum >= options.v_datum_count)
+    {
+      errorMessage (tr ("Invalid vertical datum"));
+      return (NVFalse);
+    }
+
+
+  //  The separation surface is used instead of the elevation offset.
+
+  if (!sep_file_name.isEmpty ()) options.elev_off = 0.0;
+
+
+  //  Got to have a title and an abstract.
+
+  if (options.title.isEmpty ()) options.title = QFileInfo (output_file_name).baseName ();
+  if (options.abstract.isEmpty ()) options.abstract = QFileInfo (output_file_name).baseName ();
+
+
+  return (NVTrue);
+}
+
+
+
+//  Returns the exit status for main.
+
+int32_t 
+pfmBagBatch::run ()
+{
+  /*  Override the HDF5 version check so that we can read BAGs created with an older version of HDF5.  */
+
+  putenv ((char *) "HDF5_DISABLE_VERSION_CHECK=2");
+
+
+  if (!read_vertical_datums (&options))
+    {
+      errorMessage (tr ("Can't open the vertical datum file"));
+      return (-1);
+    }
+
+
+  //  Get the user's defaults if available.  Unlike the wizard, we never save them.
+
+  envin (&options);
+
+  options.declassDate = QDate::currentDate ().addYears (10);
+  options.compDate = QDate::currentDate ();
+  options.title = "";
+  options.abstract = "";
+
+
+  //  Asking for the usage message isn't an error.
+
+  if (!parseArguments ()) return (help ? 0 : -1);
+
+
+  if (getenv ("BAG_HOME") == NULL)
+    {
+      errorMessage (tr ("BAG_HOME environment variable is not set.\nThis must point to the configdata directory or pfmBag will fail."));
+      return (-1);
+    }
+
+
+  if (!checkOptions ()) return (-1);
+
+
+  CONVERT_OPTIONS convert_options;
+
+  set_convert_options (&options, output_file_name, area_file_name, sep_file_name, &convert_options);
+
+
+  pfmBagEngine engine (&convert_options, this);
+
+  if (!engine.run ()) return (-1);
+
+
+  statusMessage (tr ("Conversion complete"));
+
+
+  return (0);
+}
+
+
+
+//  pfmBagCallback functions used by the conversion engine.
+
+void 
+pfmBagBatch::progressRange (int32_t stage, int32_t min __attribute__ ((unused)), int32_t max)
+{
+  range_max[stage] = max;
+  percent[stage] = -1;
+}
+
+
+
+void 
+pfmBagBatch::progressValue (int32_t stage, int32_t value)
+{
+  static const char *stage_name[3] = {"Computing weights", "Writing surface", "Writing tracking list"};
+
+
+  int32_t pct = 100;
+  if (range_max[stage] > 0) pct = (int32_t) (((float) value / (float) range_max[stage]) * 100.0);
+
+  if (pct == percent[stage]) return;
+
+  percent[stage] = pct;
+
+  fprintf (stderr, "%s : %03d%% processed\r", stage_name[stage], pct);
+  if (pct == 100) fprintf (stderr, "\n");
+  fflush (stderr);
+}
+
+
+
+void 
+pfmBagBatch::statusMessage (QString msg)
+{
+  fprintf (stdout, "%s\n", msg.toLatin1 ().data ());
+  fflush (stdout);
+}
+
+
+
+void 
+pfmBagBatch::warningMessage (QString msg)
+{
+  fprintf (stderr, "%s : Warning : %s\n", options.progname, msg.toLatin1 ().data ());
+  fflush (stderr);
+}
+
+
+
+void 
+pfmBagBatch::errorMessage (QString msg)
+{
+  fprintf (stderr, "%s : Error : %s\n", options.progname, msg.toLatin1 ().data ());
+  fflush (stderr);
+}
@@ -0,0 +1,95 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#ifndef PFMBAGBATCH_H
+#define PFMBAGBATCH_H
+
+#include <getopt.h>
+
+#include "pfmBagDef.hpp"
+
+
+/*!
+    Command line (batch) mode for pfmBag.  This uses the same pfmBag.ini defaults as the wizard (via envin) and
+    overrides them with whatever is on the command line.  Since there is no operator to click through the pages,
+    all of the checks that the wizard pages do (CUBE availability, bin size, uncertainty type, CRS) are done here
+    before the engine is run.  Progress and status go to stderr/stdout.
+*/
+
+class pfmBagBatch : public pfmBagCallback
+{
+  Q_DECLARE_TR_FUNCTIONS (pfmBagBatch)
+
+
+public:
+
+  pfmBagBatch (int32_t argc, char **argv);
+  ~pfmBagBatch ();
+
+  int32_t run ();
+
+
+protected:
+
+  void usage ();
+  uint8_t parseArguments ();
+  uint8_t checkOptions ();
+  QString readWkt (QString arg);
+  QString stripVertical (QString wkt);
+
+  void progressRange (int32_t stage, int32_t min, int32_t max);
+  void progressValue (int32_t stage, int32_t value);
+  void statusMessage (QString msg);
+  void warningMessage (QString msg);
+  void errorMessage (QString msg);
+
+
+  int32_t          argc;
+
+  char             **argv;
+
+  OPTIONS          options;
+
+  QString          output_file_name, area_file_name, sep_file_name;
+
+  uint8_t          surface_set, uncertainty_set, mbin_set, gbin_set, help;
+
+  int32_t          range_max[3], percent[3];
+};
+
+#endif
@@ -44,39 +44,10 @@
 #if QT_VERSION >= 0x050000
 #include <QtWidgets>
 #endif
-#include <stdtypes.h>
-#include <proj_api.h>
+#include "pfmBagEngine.hpp"
 
-#include "nvutility.h"
 #include "nvutility.hpp"
 
-#include "pfm.h"
-#include "hyp.h"
-#include "hdf5.h"
-
-#include <gdal.h>
-#include <gdal_priv.h>
-#include <cpl_string.h>
-#include <ogr_spatialref.h>
-
-#include "bag.h"
-#include "bag_legacy.h"
-
-#include "binaryFeatureData.h"
-
-#include "chrtr2.h"
-#include "shapefil.h"
-
-
-#define MIN_SURFACE  0
-#define MAX_SURFACE  1
-#define AVG_SURFACE  2
-#define CUBE_SURFACE 3
-
-#define STD_UNCERT   0
-#define TPE_UNCERT   1
-#define FIN_UNCERT   2
-
 
 typedef struct
 {
@@ -125,6 +96,14 @@ typedef struct
   QString       output_dir;
   QString       area_dir;
   QString       sep_dir;
+  int32_t       threads;               //  Number of gridding threads (0 - use the number of processors)
+  int32_t       weight_engine;         //  GATHER_WEIGHTS or SPLAT_WEIGHTS
+  double        approx_error;          //  Maximum error (meters) for approximate UTM cell corner transforms (0.0 - exact)
+  int32_t       grid_engine;           //  GATHER_GRID or SCATTER_GRID
+  int32_t       depth_cache;           //  Size (MB) of each gridding thread's depth array cache (0 - no cache)
+  int32_t       prefetch;              //  Number of BAG rows to read ahead of each gridding thread (0 - no read ahead)
+  uint8_t       cube_fast;             //  CUBE surface counts from the bin records (soundings only for weighted cells)
+  uint8_t       file_hints;            //  Tell the kernel which parts of the PFM bin and depth files we'll be reading
   char          progname[256];
   QFont         font;                  //  Font used for all ABE GUI applications
 } OPTIONS;
@@ -142,5 +121,11 @@ typedef struct
 } RUN_PROGRESS;
 
 
+void envin (OPTIONS *options);
+void envout (OPTIONS *options);
+uint8_t read_vertical_datums (OPTIONS *options);
+void set_convert_options (OPTIONS *options, QString output_file_name, QString area_file_name, QString sep_file_name, CONVERT_OPTIONS *op);
+
+
 
 #endif
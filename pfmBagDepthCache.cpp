@@ -0,0 +1,387 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#include "pfmBagDepthCache.hpp"
+#include "pfmBagPrefetchThread.hpp"
+
+
+pfmBagDepthCache::pfmBagDepthCache (int32_t handle, int32_t megabytes, pfmBagPrefetchThread *pre)
+{
+  pfm_handle = handle;
+  prefetch = pre;
+  hits = misses = 0;
+  clear_soundings (&uncached);
+  clear_soundings (&scratch);
+
+  entry = NULL;
+  entry_size = entry_count = 0;
+  free_entry = head = tail = -1;
+
+  table = NULL;
+  table_size = table_bits = table_count = 0;
+
+  bytes = 0;
+  max_bytes = (int64_t) qMax (megabytes, 0) * 1048576;
+}
+
+
+
+pfmBagDepthCache::~pfmBagDepthCache ()
+{
+  for (int32_t e = head ; e >= 0 ; e = entry[e].next) free_soundings (&entry[e].batch);
+
+  free (entry);
+  free (table);
+  free_soundings (&uncached);
+  free_soundings (&scratch);
+}
+
+
+
+//  Hash table slot that key would be in if there were no collisions (Fibonacci hashing).
+
+uint32_t 
+pfmBagDepthCache::home (int64_t key)
+{
+  return ((uint32_t) (((uint64_t) key * 0x9e3779b97f4a7c15ULL) >> (64 - table_bits)));
+}
+
+
+
+//  Return the entry for key or -1 if it isn't in the cache.
+
+int32_t 
+pfmBagDepthCache::find (int64_t key)
+{
+  if (!table_count) return (-1);
+
+
+  uint32_t mask = table_size - 1;
+
+  for (uint32_t i = home (key) ; table[i] >= 0 ; i = (i + 1) & mask)
+    {
+      if (entry[table[i]].key == key) return (table[i]);
+    }
+
+  return (-1);
+}
+
+
+
+//  Double the size of the hash table (it starts at 1024 slots) and rehash the entries.
+
+uint8_t 
+pfmBagDepthCache::growTable ()
+{
+  uint32_t new_bits = table_bits ? table_bits + 1 : 10;
+  uint32_t new_size = 1 << new_bits;
+
+  int32_t *new_table = (int32_t *) malloc (new_size * sizeof (int32_t));
+  if (new_table == NULL) return (NVFalse);
+
+  for (uint32_t i = 0 ; i < new_size ; i++) new_table[i] = -1;
+
+  free (table);
+  table = new_table;
+  table_size = new_size;
+  table_bits = new_bits;
+
+
+  uint32_t mask = table_size - 1;
+
+  for (int32_t e = head ; e >= 0 ; e = entry[e].next)
+    {
+      uint32_t i = home (entry[e].key);
+      while (table[i] >= 0) i = (i + 1) & mask;
+      table[i] = e;
+    }
+
+  return (NVTrue);
+}
+
+
+
+//  Remove entry e from the hash table.  Linear probing so we shift the following entries back instead of leaving
+//  a tombstone.
+
+void 
+pfmBagDepthCache::unhash (int32_t e)
+{
+  uint32_t mask = table_size - 1;
+  uint32_t i = home (entry[e].key);
+
+  while (table[i] != e) i = (i + 1) & mask;
+
+
+  uint32_t j = i;
+
+  while (NVTrue)
+    {
+      j = (j + 1) & mask;
+
+      if (table[j] < 0) break;
+
+
+      //  The entry in slot j can be moved to slot i if its home isn't (cyclically) between i and j.
+
+      uint32_t k = home (entry[table[j]].key);
+
+      if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j)))
+        {
+          table[i] = table[j];
+          i = j;
+        }
+    }
+
+  table[i] = -1;
+  table_count--;
+}
+
+
+
+//  Take entry e out of the least recently used list.
+
+void 
+pfmBagDepthCache::unlink (int32_t e)
+{
+  if (entry[e].prev >= 0)
+    {
+      entry[entry[e].prev].next = entry[e].next;
+    }
+  else
+    {
+      head = entry[e].next;
+    }
+
+  if (entry[e].next >= 0)
+    {
+      entry[entry[e].next].prev = entry[e].prev;
+    }
+  else
+    {
+      tail = entry[e].prev;
+    }
+}
+
+
+
+//  What an entry costs against the cache size.  Besides the decoded soundings each entry has its bookkeeping (the
+//  entry and, since the hash table is kept no more than half full, two table slots) so empty PFM cells aren't free.
+
+static int64_t 
+entry_bytes (int32_t numrecs)
+{
+  return (sounding_bytes (numrecs) + sizeof (DEPTH_CACHE_ENTRY) + 2 * sizeof (int32_t));
+}
+
+
+
+//  Throw away the least recently used depth array.
+
+void 
+pfmBagDepthCache::evict ()
+{
+  int32_t e = tail;
+
+  unhash (e);
+  unlink (e);
+
+  bytes -= entry_bytes (entry[e].batch.count);
+  free_soundings (&entry[e].batch);
+
+  entry[e].next = free_entry;
+  free_entry = e;
+}
+
+
+
+//  Add a decoded depth array to the cache as the most recently used.  The cache takes over the batch's arrays (and
+//  batch is cleared).  Returns NVFalse if it won't fit or the cache is disabled (the caller still owns it).
+
+uint8_t 
+pfmBagDepthCache::add (int64_t key, SOUNDING_BATCH *batch)
+{
+  int64_t size = entry_bytes (batch->count);
+
+  if (!max_bytes || size > max_bytes) return (NVFalse);
+
+  while (head >= 0 && bytes + size > max_bytes) evict ();
+
+
+  //  Keep the hash table no more than half full.
+
+  if ((table_count + 1) * 2 > table_size && !growTable ()) return (NVFalse);
+
+
+  if (free_entry < 0)
+    {
+      if (entry_count == entry_size)
+        {
+          int32_t new_size = entry_size ? entry_size * 2 : 256;
+
+          DEPTH_CACHE_ENTRY *new_entry = (DEPTH_CACHE_ENTRY *) realloc (entry, new_size * sizeof (DEPTH_CACHE_ENTRY));
+          if (new_entry == NULL) return (NVFalse);
+
+          entry = new_entry;
+          entry_size = new_size;
+        }
+
+      free_entry = entry_count++;
+      entry[free_entry].next = -1;
+    }
+
+  int32_t e = free_entry;
+  free_entry = entry[e].next;
+
+  entry[e].key = key;
+  entry[e].batch = *batch;
+  clear_soundings (batch);
+  entry[e].prev = -1;
+  entry[e].next = head;
+
+  if (head >= 0) entry[head].prev = e;
+  head = e;
+  if (tail < 0) tail = e;
+
+  bytes += size;
+
+
+  uint32_t mask = table_size - 1;
+  uint32_t i = home (key);
+
+  while (table[i] >= 0) i = (i + 1) & mask;
+  table[i] = e;
+  table_count++;
+
+
+  return (NVTrue);
+}
+
+
+
+/*!
+    Get the decoded depth array for PFM cell coord.  batch is set to NULL if libpfm couldn't read it (the cell is
+    skipped, as it always has been).  Returns NVFalse if we ran out of memory decoding it.  The batch belongs to the
+    cache and is only valid until the next call.
+*/
+
+uint8_t 
+pfmBagDepthCache::read (NV_I32_COORD2 coord, SOUNDING_BATCH **batch)
+{
+  int64_t key = ((int64_t) coord.y << 32) | (uint32_t) coord.x;
+
+
+  //  The array that didn't fit in the cache the last time is no longer needed.
+
+  free_soundings (&uncached);
+
+
+  int32_t e = find (key);
+
+  if (e >= 0)
+    {
+      hits++;
+
+
+      //  Move it to the front of the list.
+
+      if (e != head)
+        {
+          unlink (e);
+          entry[e].prev = -1;
+          entry[e].next = head;
+          entry[head].prev = e;
+          head = e;
+        }
+
+      *batch = &entry[e].batch;
+
+      return (NVTrue);
+    }
+
+
+  misses++;
+
+  SOUNDING_BATCH fresh;
+  clear_soundings (&fresh);
+
+  if (!prefetch || !prefetch->take (coord, &fresh))
+    {
+      DEPTH_RECORD *depth;
+      int32_t numrecs;
+
+      if (read_depth_array_index (pfm_handle, coord, &depth, &numrecs))
+        {
+          *batch = NULL;
+          return (NVTrue);
+        }
+
+
+      //  Arrays that can't go in the cache (or all of them if the cache is disabled) are decoded into the scratch
+      //  batch so we don't allocate for them.
+
+      uint8_t fits = (max_bytes && entry_bytes (numrecs) <= max_bytes);
+      uint8_t ok = decode_soundings (depth, numrecs, fits ? &fresh : &scratch);
+
+      free (depth);
+
+      if (!ok) return (NVFalse);
+
+      if (!fits)
+        {
+          *batch = &scratch;
+          return (NVTrue);
+        }
+    }
+
+
+  //  If it didn't go in the cache after all we hold it until the next call.
+
+  if (add (key, &fresh))
+    {
+      *batch = &entry[head].batch;
+    }
+  else
+    {
+      uncached = fresh;
+      *batch = &uncached;
+    }
+
+
+  return (NVTrue);
+}
@@ -0,0 +1,124 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#ifndef PFMBAGDEPTHCACHE_H
+#define PFMBAGDEPTHCACHE_H
+
+#include <QtCore>
+#include <stdtypes.h>
+
+#include "pfm.h"
+
+#include "pfmBagSoundings.hpp"
+
+
+class pfmBagPrefetchThread;
+
+
+/*!
+    A cached (decoded) depth array.  Unused entries are chained together through next.
+*/
+
+typedef struct
+{
+  int64_t          key;
+  SOUNDING_BATCH   batch;
+  int32_t          prev;                   //  Next more recently used entry (-1 if this is the most recently used)
+  int32_t          next;                   //  Next less recently used entry (-1 if this is the least recently used)
+} DEPTH_CACHE_ENTRY;
+
+
+
+/*!
+    A least recently used cache of PFM depth arrays keyed by PFM cell coordinate that sits between the gathering
+    gridding loop and libpfm.  Adjacent BAG cells whose bounds straddle a PFM cell would otherwise each read (and
+    free) the same depth array.  Each gridding context has its own cache since it's tied to the context's PFM
+    handle.  The arrays are kept decoded (decode_soundings) so that each one is only decoded once no matter how many
+    BAG cells use it.  The cache owns the returned batches, they are only valid until the next call to read.  A cache
+    size of 0 megabytes disables caching (read just decodes into a scratch batch that is reused).  Every entry is
+    charged its bookkeeping as well as its soundings so a survey that's mostly empty PFM cells can't grow the cache
+    without limit.  If there is a read ahead thread (prefetch) arrays that aren't in the cache are taken (already
+    decoded) from its ready buffer before going to libpfm.
+    <br><br>
+    The entries and the open addressing hash table that indexes them are grow-only arrays that are reused as arrays
+    are evicted so, once the cache has warmed up, reading a PFM cell only allocates the depth array that libpfm returns
+    and the batch it's decoded into.
+*/
+
+class pfmBagDepthCache
+{
+public:
+
+  pfmBagDepthCache (int32_t handle, int32_t megabytes, pfmBagPrefetchThread *pre);
+  ~pfmBagDepthCache ();
+
+  uint8_t read (NV_I32_COORD2 coord, SOUNDING_BATCH **batch);
+
+
+  int64_t          hits, misses;
+
+
+protected:
+
+  uint32_t home (int64_t key);
+  int32_t find (int64_t key);
+  uint8_t add (int64_t key, SOUNDING_BATCH *batch);
+  void evict ();
+  void unlink (int32_t e);
+  void unhash (int32_t e);
+  uint8_t growTable ();
+
+
+  pfmBagPrefetchThread *prefetch;
+
+  int32_t          pfm_handle;
+
+  SOUNDING_BATCH   uncached, scratch;
+
+  DEPTH_CACHE_ENTRY *entry;
+
+  int32_t          entry_size, entry_count, free_entry, head, tail;
+
+  int32_t          *table;
+
+  uint32_t         table_size, table_bits, table_count;
+
+  int64_t          bytes, max_bytes;
+};
+
+#endif
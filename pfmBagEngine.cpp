@@ -0,0 +1,4434 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#include "pfmBagEngine.hpp"
+#include "pfmBagGridThread.hpp"
+#include "pfmBagWeightThread.hpp"
+
+
+pfmBagEngine::pfmBagEngine (CONVERT_OPTIONS *op, pfmBagCallback *cb)
+{
+  options = *op;
+  callback = cb;
+
+  pfm_handle = -1;
+  bfd_handle = -1;
+  bag_width = bag_height = 0;
+  fu_attr = hs_attr = nh_attr = -1;
+  feature = NULL;
+  eligible = NULL;
+  eligible_index = NULL;
+  eligible_count = 0;
+  features = NVFalse;
+  enhanced = NVFalse;
+  pfm_proj = bag_proj = NULL;
+  pfm_proj4[0] = bag_proj4[0] = 0;
+  io_crs_equal = NVFalse;
+  mbr.min_x = mbr.min_y = mbr.max_x = mbr.max_y = 0.0;
+  proj_mbr.min_x = proj_mbr.min_y = proj_mbr.max_x = proj_mbr.max_y = 0.0;
+  x_bin_size_degrees = y_bin_size_degrees = half_x = half_y = 0.0;
+  xmlBuffer = NULL;
+  clear_weight_grid (&weight);
+  bucket_start = bucket_feature = NULL;
+  bucket_width = bucket_height = 0;
+  geo_rows = NULL;
+  feature_cells = NULL;
+  elevation = uncert = NULL;
+  optsol = NULL;
+  cube = NULL;
+  band = NULL;
+  band_rows = band_count = band_slots = next_band = write_band = 0;
+  grid_abort = error_reported = scatter = NVFalse;
+  approx_error = 0.0;
+  cache_hits = cache_misses = prefetched = 0;
+  file_hints = NULL;
+  handle_pool = NULL;
+  area_x = area_y = NULL;
+  area_count = area_parts = 0;
+  area_part = NULL;
+  mask_row = mask_span = NULL;
+  hint_row[0] = hint_row[1] = 0;
+
+  memset (&data, 0, sizeof (data));
+}
+
+
+
+pfmBagEngine::~pfmBagEngine ()
+{
+  free_weight_grid (&weight);
+
+  free (bucket_start);
+  free (bucket_feature);
+  free (geo_rows);
+  free (feature_cells);
+
+  free (area_x);
+  free (area_y);
+  free (area_part);
+  free (mask_row);
+  free (mask_span);
+
+  delete file_hints;
+
+
+  //  Free the arrays.
+
+  free (elevation);
+  free (uncert);
+  free (optsol);
+  free (cube);
+
+
+  //  IMPORTANT NOTE: bagFileClose will free the xmlBuffer so closeBag sets it to NULL.
+
+  free (xmlBuffer);
+
+
+  //  Closing the bfd file frees the short feature structure.
+
+  if (bfd_handle >= 0) binaryFeatureData_close_file (bfd_handle);
+
+  free (eligible);
+  free (eligible_index);
+
+  if (pfm_handle >= 0) close_pfm_file (pfm_handle);
+
+  delete handle_pool;
+
+  if (pfm_proj) pj_free (pfm_proj);
+  if (bag_proj) pj_free (bag_proj);
+}
+
+
+
+//  Do the whole conversion.  If anything goes wrong the callback's error function has already been called when this returns NVFalse.
+
+uint8_t 
+pfmBagEngine::run ()
+{
+  if (!openFiles ()) return (NVFalse);
+
+  if (!defineMetadata ()) return (NVFalse);
+
+  if (!defineArea ()) return (NVFalse);
+
+  if (!defineCRS ()) return (NVFalse);
+
+  if (!defineGrid ()) return (NVFalse);
+
+  if (!buildAreaMask ()) return (NVFalse);
+
+  if (!selectFeatures ()) return (NVFalse);
+
+  if (!computeWeights ()) return (NVFalse);
+
+  if (!defineLineage ()) return (NVFalse);
+
+  if (!createBag ()) return (NVFalse);
+
+  if (!writeSurface ()) return (NVFalse);
+
+  if (!writeTrackingList ()) return (NVFalse);
+
+  if (!updateSurfaces ()) return (NVFalse);
+
+  if (!writeSeparation ()) return (NVFalse);
+
+  if (!closeBag ()) return (NVFalse);
+
+  return (NVTrue);
+}
+
+
+
+uint8_t 
+pfmBagEngine::transformError (int32_t status, int32_t line, const char *function, double in_x, double in_y, double out_x, double out_y)
+{
+  //  This can be called from more than one gridding thread at a time.  We only want to hear about the first one.
+
+  QMutexLocker lock (&error_mutex);
+
+  if (error_reported) return (NVFalse);
+  error_reported = NVTrue;
+
+
+  QString err_str = tr ("Proj.4 transform error at line %1 in %2\nError: %3\nInputs: %L4, %L5\nOutputs: %L6, %L7").arg (line).arg (function).arg
+    (pj_strerrno (status)).arg (in_x, 0, 'f', 11).arg (in_y, 0, 'f', 11).arg (out_x, 0, 'f', 11).arg (out_y, 0, 'f', 11);
+
+  callback->errorMessage (err_str);
+
+  return (NVFalse);
+}
+
+
+
+uint8_t 
+pfmBagEngine::bagFailure (QString string, bagError err)
+{
+  u8 *errstr;
+
+  if (bagGetErrorString (err, &errstr) == BAG_SUCCESS) string += (QString (" : ") + QString ((char *) errstr));
+
+  callback->errorMessage (string);
+
+  return (NVFalse);
+}
+
+
+
+uint8_t 
+pfmBagEngine::memoryError (const char *what, int32_t line, const char *function)
+{
+  //  Like transformError this can be called from the gridding threads.
+
+  QMutexLocker lock (&error_mutex);
+
+  if (error_reported) return (NVFalse);
+  error_reported = NVTrue;
+
+
+  QString string;
+
+  string.sprintf (tr ("%s %s %s %d - %s - %s").toLatin1 (), options.progname, __FILE__, function, line, what, strerror (errno));
+
+  callback->errorMessage (string);
+
+  return (NVFalse);
+}
+
+
+
+/*!
+    Lease a PFM handle from the handle pool for a thread we're about to start (what names it for the error message).
+    The engine does this before the threads that would give handles back are running so nothing could release one
+    while we waited, which is why we don't wait.  Returns -1 (after reporting the error) if we can't get one.
+*/
+
+int32_t 
+pfmBagEngine::leaseHandle (QString what)
+{
+  int32_t hnd = handle_pool->tryLease ();
+
+  if (hnd == LEASE_NONE_FREE)
+    {
+      callback->errorMessage (tr ("No PFM handle for %1, all %2 handles are in use").arg (what).arg (MAX_POOL_HANDLES));
+      return (-1);
+    }
+
+  if (hnd < 0)
+    {
+      callback->errorMessage (tr ("Unable to open %1 for %2.\nThe error message returned was:\n\n%3").arg
+                              (options.pfm_file_name).arg (what).arg (pfm_error_str (pfm_error)));
+      return (-1);
+    }
+
+  return (hnd);
+}
+
+
+
+//  Open the PFM and, if there is one, the feature file.
+
+uint8_t 
+pfmBagEngine::openFiles ()
+{
+  strcpy (open_args.list_path, options.pfm_file_name.toLatin1 ());
+
+
+  open_args.checkpoint = 0;
+  pfm_handle = open_existing_pfm_file (&open_args);
+
+
+  if (pfm_handle < 0)
+    {
+      callback->errorMessage (tr ("The file %1 is not a PFM structure or there was an error reading the file.\nThe error message returned was:\n\n%2").arg
+                       (options.pfm_file_name).arg (pfm_error_str (pfm_error)));
+      return (NVFalse);
+    }
+
+
+  //  Worker threads lease their own handles on the PFM from the pool.
+
+  handle_pool = new pfmBagHandlePool (open_args.list_path, MAX_POOL_HANDLES);
+
+
+  if (strcmp (open_args.target_path, "NONE"))
+    {
+      if ((bfd_handle = binaryFeatureData_open_file (open_args.target_path, &bfd_header, BFDATA_READONLY)) < 0)
+        {
+          QString msg = QString (binaryFeatureData_strerror ());
+          callback->warningMessage (tr ("Unable to open feature file\nReason: %1").arg (msg));
+          features = NVFalse;
+        }
+      else
+        {
+          binaryFeatureData_read_all_short_features (bfd_handle, &feature);
+          features = NVTrue;
+        }
+    }
+
+
+  //  Can't make an enhanced surface without features or using minutes.
+
+  enhanced = options.enhanced;
+  if (!features || options.mbin_size == 0.0) enhanced = NVFalse;
+
+
+  //  Figure out where (if anywhere) the final uncertainty, hypothesis strength, and number of hypotheses attributes are stored.
+
+  for (int32_t i = 0 ; i < open_args.head.num_bin_attr ; i++)
+    {
+      if (strstr (open_args.head.bin_attr_name[i], "###5")) fu_attr = i;
+      if (strstr (open_args.head.bin_attr_name[i], "###2")) hs_attr = i;
+      if (strstr (open_args.head.bin_attr_name[i], "###0")) nh_attr = i;
+    }
+
+
+  return (NVTrue);
+}
+
+
+
+//  Initialize the bag_metadata structure and move the data into the BAG metadata identificationInfo Structure.
+
+uint8_t 
+pfmBagEngine::defineMetadata ()
+{
+  bagError stat;
+
+
+  //  Initialize the bag_metadata structure
+
+  stat = bagInitMetadata (&bag_metadata);
+  if (stat != BAG_SUCCESS) return (bagFailure (tr ("Error initializing metadata"), stat));
+
+
+  bag_metadata.fileIdentifier = (u8 *) malloc (sizeof (u8) * 5);
+  strcpy ((char *) bag_metadata.fileIdentifier, "test");
+  bag_metadata.language = (u8 *) malloc (sizeof (u8) * 5);
+  strcpy ((char *) bag_metadata.language, "en");
+
+  QDate current_date = QDate::currentDate ();
+
+  QString date_string = current_date.toString ("yyyy-MM-dd");
+
+  bag_metadata.dateStamp = (u8 *) malloc (sizeof (u8) * date_string.size () + 1);
+  strcpy ((char *) bag_metadata.dateStamp , date_string.toLatin1 ());
+
+
+  //  Move the data into the BAG metadata identificationInfo Structure
+
+  bag_metadata.identificationInfo->title = (u8 *) malloc (sizeof (u8) * options.title.size () + 1);
+  strcpy ((char*) bag_metadata.identificationInfo->title, options.title.toLatin1 ());
+
+  bag_metadata.identificationInfo->date = (u8 *) malloc (sizeof (u8) * date_string.size () + 1);
+  strcpy ((char *) bag_metadata.identificationInfo->date, date_string.toLatin1 ());
+
+  bag_metadata.identificationInfo->dateType = (u8 *) malloc (sizeof (u8) * 12);
+  strcpy ((char *) bag_metadata.identificationInfo->dateType, tr ("publication").toLatin1 ());
+
+  bag_metadata.identificationInfo->numberOfResponsibleParties = 1;
+  bag_metadata.identificationInfo->responsibleParties = (BAG_RESPONSIBLE_PARTY *) malloc (sizeof (BAG_RESPONSIBLE_PARTY));
+
+  bag_metadata.identificationInfo->responsibleParties[0].individualName = (u8 *) malloc (sizeof (u8) * options.pi_name.size () + 1);
+  strcpy ((char *) bag_metadata.identificationInfo->responsibleParties[0].individualName, options.pi_name.toLatin1 ());
+
+  bag_metadata.identificationInfo->responsibleParties[0].positionName = (u8 *) malloc (sizeof (u8) * options.pi_title.size () + 1);
+  strcpy ((char *) bag_metadata.identificationInfo->responsibleParties[0].positionName, options.pi_title.toLatin1 ());
+
+  bag_metadata.identificationInfo->responsibleParties[0].organisationName = (u8 *) malloc (sizeof (u8) * 27);
+  strcpy ((char *) bag_metadata.identificationInfo->responsibleParties[0].organisationName, tr ("Naval Oceanographic Office").toLatin1 ());
+
+  bag_metadata.identificationInfo->responsibleParties[0].role = (u8 *) malloc (sizeof (u8) * 23);
+  strcpy ((char *) bag_metadata.identificationInfo->responsibleParties[0].role, tr ("Principal investigator").toLatin1 ());
+
+  bag_metadata.identificationInfo->abstractString = (u8 *) malloc (sizeof (u8) * options.abstract.size () + 1);
+  strcpy ((char *) bag_metadata.identificationInfo->abstractString, options.abstract.toLatin1 ());
+
+  bag_metadata.identificationInfo->status = (u8 *) malloc (sizeof (u8) * 9);
+  strcpy ((char *) bag_metadata.identificationInfo->status, "Complete");
+
+  bag_metadata.identificationInfo->language = (u8 *) malloc (sizeof (u8) * 3);
+  strcpy ((char *) bag_metadata.identificationInfo->language, "en");
+
+  bag_metadata.identificationInfo->topicCategory = (u8 *) malloc (sizeof (u8) * 10);
+  strcpy ((char *) bag_metadata.identificationInfo->topicCategory, "elevation");
+
+  bag_metadata.identificationInfo->spatialRepresentationType = (u8 *) malloc (sizeof (u8) * 5);
+  strcpy ((char *) bag_metadata.identificationInfo->spatialRepresentationType, "grid");
+
+  bag_metadata.identificationInfo->nodeGroupType = (u8 *) malloc (sizeof (u8) * 8);
+  strcpy ((char *) bag_metadata.identificationInfo->nodeGroupType, "unknown");
+
+  bag_metadata.identificationInfo->elevationSolutionGroupType = (u8 *) malloc (sizeof (u8) * 8);
+  strcpy ((char *) bag_metadata.identificationInfo->elevationSolutionGroupType, "unknown");
+
+
+  return (NVTrue);
+}
+
+
+
+/*!
+    Read the area file into area_x and area_y and set mbr to its bounds.  The area can have any number of vertices
+    and any number of rings (area_parts), ring p is vertices area_part[p] through area_part[p + 1] - 1.  Shape files
+    are read with shapelib so that every part of every shape is used (a polyline is closed back to its start).  The
+    other formats (.ARE, .are, .afs) are read by get_area_mbr with vertex arrays big enough for every line in the
+    file.
+*/
+
+uint8_t 
+pfmBagEngine::readArea ()
+{
+  char area_file[1024];
+
+  strcpy (area_file, options.area_file_name.toLocal8Bit ());
+
+
+  if (options.area_file_name.endsWith (".shp", Qt::CaseInsensitive))
+    {
+      SHPHandle shp_handle;
+      int32_t num_shapes, type;
+      double min_bounds[4], max_bounds[4];
+
+
+      if ((shp_handle = SHPOpen (area_file, "rb")) == NULL)
+        {
+          callback->errorMessage (tr ("Cannot open shape file %1!").arg (options.area_file_name));
+          return (NVFalse);
+        }
+
+      SHPGetInfo (shp_handle, &num_shapes, &type, min_bounds, max_bounds);
+
+      if (type != SHPT_POLYGON && type != SHPT_POLYGONZ && type != SHPT_POLYGONM &&
+          type != SHPT_ARC && type != SHPT_ARCZ && type != SHPT_ARCM)
+        {
+          SHPClose (shp_handle);
+          callback->errorMessage (tr ("Shape file %1 is not a polygon or polyline file!").arg (options.area_file_name));
+          return (NVFalse);
+        }
+
+
+      for (int32_t i = 0 ; i < num_shapes ; i++)
+        {
+          SHPObject *shape = SHPReadObject (shp_handle, i);
+
+          if (shape == NULL) continue;
+
+          int32_t parts = qMax (shape->nParts, 1);
+
+          //  Grow the arrays through temporaries so a failed realloc doesn't lose the buffer.  Any that did grow are
+          //  kept (the old pointer isn't valid any more), area_count and area_parts aren't touched unless they all did.
+
+          int32_t new_count = qMax (area_count + shape->nVertices, 1);
+
+          double *new_x = (double *) realloc (area_x, new_count * sizeof (double));
+          if (new_x) area_x = new_x;
+          double *new_y = (double *) realloc (area_y, new_count * sizeof (double));
+          if (new_y) area_y = new_y;
+          int32_t *new_part = (int32_t *) realloc (area_part, (area_parts + parts + 1) * sizeof (int32_t));
+          if (new_part) area_part = new_part;
+
+          if (new_x == NULL || new_y == NULL || new_part == NULL)
+            {
+              SHPDestroyObject (shape);
+              SHPClose (shp_handle);
+              return (memoryError ("area polygon", __LINE__, __FUNCTION__));
+            }
+
+          for (int32_t k = 0 ; k < parts ; k++) area_part[area_parts++] = area_count + (shape->nParts ? shape->panPartStart[k] : 0);
+
+          for (int32_t j = 0 ; j < shape->nVertices ; j++)
+            {
+              area_x[area_count + j] = shape->padfX[j];
+              area_y[area_count + j] = shape->padfY[j];
+            }
+
+          area_count += shape->nVertices;
+          area_part[area_parts] = area_count;
+
+          SHPDestroyObject (shape);
+        }
+
+      SHPClose (shp_handle);
+
+
+      if (area_count < 3)
+        {
+          callback->errorMessage (tr ("Number of vertices (%1) of shape file %2 is too few for a polygon!").arg (area_count).arg
+                                  (options.area_file_name));
+          return (NVFalse);
+        }
+
+
+      mbr.min_x = mbr.max_x = area_x[0];
+      mbr.min_y = mbr.max_y = area_y[0];
+
+      for (int32_t i = 1 ; i < area_count ; i++)
+        {
+          mbr.min_x = qMin (mbr.min_x, area_x[i]);
+          mbr.max_x = qMax (mbr.max_x, area_x[i]);
+          mbr.min_y = qMin (mbr.min_y, area_y[i]);
+          mbr.max_y = qMax (mbr.max_y, area_y[i]);
+        }
+    }
+  else
+    {
+      //  There's at most one vertex per line.
+
+      QFile file (options.area_file_name);
+
+      if (!file.open (QIODevice::ReadOnly))
+        {
+          callback->errorMessage (tr ("Cannot open area file %1!").arg (options.area_file_name));
+          return (NVFalse);
+        }
+
+      int32_t lines = 1;
+      while (!file.atEnd ())
+        {
+          file.readLine ();
+          lines++;
+        }
+
+      file.close ();
+
+
+      area_x = (double *) malloc (lines * sizeof (double));
+      area_y = (double *) malloc (lines * sizeof (double));
+      area_part = (int32_t *) malloc (2 * sizeof (int32_t));
+
+      if (area_x == NULL || area_y == NULL || area_part == NULL) return (memoryError ("area polygon", __LINE__, __FUNCTION__));
+
+      get_area_mbr (area_file, &area_count, area_x, area_y, &mbr);
+
+      area_parts = 1;
+      area_part[0] = 0;
+      area_part[1] = area_count;
+    }
+
+
+  return (NVTrue);
+}
+
+
+
+//  Define the area of the BAG (from the PFM bounds or the area file), the bin sizes, and most of the non-CRS metadata.
+
+uint8_t 
+pfmBagEngine::defineArea ()
+{
+  QString string;
+
+
+  mbr = open_args.head.mbr;
+
+
+  if (!options.area_file_name.isEmpty ())
+    {
+      //  Keep the polygon so that we can mask out the cells that are outside of it (see buildAreaMask).
+
+      if (!readArea ()) return (NVFalse);
+
+      if (mbr.min_y > open_args.head.mbr.max_y || mbr.max_y < open_args.head.mbr.min_y ||
+          mbr.min_x > open_args.head.mbr.max_x || mbr.max_x < open_args.head.mbr.min_x)
+        {
+          callback->errorMessage (tr ("Specified area is completely outside of the PFM bounds!"));
+          return (NVFalse);
+        }
+    }
+
+
+  //  If mbin_size is 0.0 then we're defining bin sizes in minutes of lat/lon
+
+  x_bin_size_degrees = 0.0;
+  y_bin_size_degrees = 0.0;
+
+  if (options.mbin_size == 0.0)
+    {
+      y_bin_size_degrees = options.gbin_size / 60.0;
+      x_bin_size_degrees = y_bin_size_degrees;
+
+
+      /*  We've changed our collective minds.  After actually editing some data north of 64N we have found
+          that there is no distortion due to elongated bins.  Therefore, Paul Marin has decided (and I agree)
+          that we don't need to change the X bin size to match the Y bin size in distance.  I'm leaving the
+          code here for reference (it didn't work though because we should have set a computed XY bin size).
+          JCD  01/10/12
+
+
+      //  We're going to use approximately spatially equivalent geographic bin sizes north or 64N and south of 64S.
+      //  Otherwise we're going to use equal lat and lon bin sizes.
+
+      if (mbr.min_y >= 64.0 || mbr.max_y <= -64.0)
+        {
+          double dist, az, y, x;
+          if (mbr.min_y <= -64.0)
+            {
+              invgp (NV_A0, NV_B0, mbr.max_y, mbr.min_x, mbr.max_y - (options.gbin_size / 60.0), mbr.min_x, &dist, &az);
+            }
+          else
+            {
+              invgp (NV_A0, NV_B0, mbr.min_y, mbr.min_x, mbr.min_y + (options.gbin_size / 60.0), mbr.min_x, &dist, &az);
+            }
+
+          newgp (mbr.min_y, mbr.min_x, 90.0, dist, &y, &x);
+
+          x_bin_size_degrees = x - mbr.min_x;
+        }
+      */
+    }
+  else
+    {
+      NV_F64_COORD2 central, xy;
+
+      central.x = mbr.min_x + (mbr.max_x - mbr.min_x) / 2.0;
+      central.y = mbr.min_y + (mbr.max_y - mbr.min_y) / 2.0;
+
+
+      //  Convert from meters.
+
+      newgp (central.y, central.x, 90.0, options.mbin_size, &xy.y, &xy.x);
+
+
+      //  Check if the longitude is in the form 0 to 360.
+
+      if (central.x > 180) xy.x = xy.x + 360;
+
+      x_bin_size_degrees = xy.x - central.x;
+      newgp (central.y, central.x, 0.0, options.mbin_size, &xy.y, &xy.x);
+      y_bin_size_degrees = xy.y - central.y;
+    }
+
+
+  bag_height = NINT ((mbr.max_y - mbr.min_y) / y_bin_size_degrees + 0.05);
+  bag_width = NINT ((mbr.max_x - mbr.min_x) / x_bin_size_degrees + 0.05);
+
+
+  //  Redefine upper and right bounds
+
+  mbr.max_x = mbr.min_x + bag_width * x_bin_size_degrees;
+  mbr.max_y = mbr.min_y + bag_height * y_bin_size_degrees;
+
+
+  //  BAG metadata spatialRepresentationInfo
+
+  bag_metadata.spatialRepresentationInfo->resolutionUnit = (u8 *) malloc (sizeof (u8) * 12);
+  if (options.bag_wkt.contains ("PROJCS"))
+    {
+      strcpy ((char *) bag_metadata.spatialRepresentationInfo->resolutionUnit, "meters");
+    }
+  else
+    {
+      strcpy ((char *) bag_metadata.spatialRepresentationInfo->resolutionUnit, "degrees");
+    }
+
+  bag_metadata.spatialRepresentationInfo->transformationParameterAvailability = False;
+
+  bag_metadata.spatialRepresentationInfo->cellGeometry = (u8 *) malloc (sizeof (u8) * 6);
+  strcpy ((char *) bag_metadata.spatialRepresentationInfo->cellGeometry, "point");  
+
+  bag_metadata.spatialRepresentationInfo->transformationParameterAvailability = False;
+  bag_metadata.spatialRepresentationInfo->checkPointAvailability = False;
+
+
+  bag_metadata.identificationInfo->depthCorrectionType = (u8 *) malloc (sizeof (u8) * 30);
+
+  switch (options.depth_cor)
+    {
+    case 0:
+      strcpy ((char *) bag_metadata.identificationInfo->depthCorrectionType, tr ("Corrected depth").toLatin1 ());
+      break;
+
+    case 1:
+      strcpy ((char *) bag_metadata.identificationInfo->depthCorrectionType, tr ("Uncorrected 1500 m/s").toLatin1 ());
+      break;
+
+    case 2:
+      strcpy ((char *) bag_metadata.identificationInfo->depthCorrectionType, tr ("Uncorrected 4800 ft/s").toLatin1 ());
+      break;
+
+    case 3:
+      strcpy ((char *) bag_metadata.identificationInfo->depthCorrectionType, tr ("Uncorrected 800 fm/s").toLatin1 ());
+      break;
+
+    case 4:
+      strcpy ((char *) bag_metadata.identificationInfo->depthCorrectionType, tr ("Mixed corrections").toLatin1 ());
+      break;
+    }
+
+
+  bag_metadata.identificationInfo->verticalUncertaintyType = (u8 *) malloc (sizeof (u8) * 20);
+
+  switch (options.uncertainty)
+    {
+    case STD_UNCERT:
+      strcpy ((char *) bag_metadata.identificationInfo->verticalUncertaintyType, tr ("Std Dev").toLatin1 ());
+      break;
+
+    case TPE_UNCERT:
+      strcpy ((char *) bag_metadata.identificationInfo->verticalUncertaintyType, tr ("TPE").toLatin1 ());
+      break;
+
+    case FIN_UNCERT:
+      strcpy ((char *) bag_metadata.identificationInfo->verticalUncertaintyType, tr ("Final uncertainty").toLatin1 ());
+      break;
+    }
+
+
+  //  BAG metadata legalConstraints
+
+  bag_metadata.legalConstraints->otherConstraints = (u8 *) malloc (sizeof (u8) * 5);
+  strcpy ((char *) bag_metadata.legalConstraints->otherConstraints, " ");
+
+  bag_metadata.legalConstraints->useConstraints = (u8 *) malloc (sizeof (u8) * 5);
+  strcpy ((char *) bag_metadata.legalConstraints->useConstraints, " ");
+
+
+  //  BAG metadata securityConstraints
+
+  bag_metadata.securityConstraints->classification = (u8 *) malloc (sizeof (u8) * 14);
+
+  switch (options.classification)
+    {
+    case 0:
+      strcpy ((char *) bag_metadata.securityConstraints->classification, tr ("Unclassified").toLatin1 ());
+      break;
+
+    case 1:
+      strcpy ((char *) bag_metadata.securityConstraints->classification, tr ("Confidential").toLatin1 ());
+      break;
+
+    case 2:
+      strcpy ((char *) bag_metadata.securityConstraints->classification, tr ("Secret").toLatin1 ());
+      break;
+
+    case 3:
+      strcpy ((char *) bag_metadata.securityConstraints->classification, tr ("Top Secret").toLatin1 ());
+      break;
+    }
+
+  switch (options.authority)
+    {
+    case 0:
+      string = tr ("Classifying Authority : N/A");
+      break;
+
+    case 1:
+      string = tr ("Classifying Authority : Derived from: OPNAVINSTS5513.5B(23)\n");
+      break;
+
+    case 2:
+      string = tr ("Classifying Authority : Derived from: OPNAVINSTS5513.5B(24)\n");
+      break;
+
+    case 3:
+      string = tr ("Classifying Authority : Derived from: OPNAVINSTS5513.5B(27)\n");
+      break;
+
+    case 4:
+      string = tr ("Classifying Authority : Derived from: OPNAVINSTS5513.5B(28)\n");
+      break;
+    }
+
+  string += tr ("Declassification date : %1\n").arg(options.declassDate.toString ("yyyy-MM-dd"));
+
+  string += tr ("Distribution statement : %1").arg (options.distStatement);
+
+  bag_metadata.securityConstraints->userNote = (u8 *) malloc (sizeof (u8) * string.size () + 1);
+  strcpy ((char *) bag_metadata.securityConstraints->userNote, string.toLatin1 ());
+
+
+  strcpy ((char *) bag_metadata.dataQualityInfo->scope, tr ("dataset").toLatin1 ());
+
+  half_x = half_y = 0.0;
+
+
+  //  BAG metadata horizontalReferenceSystem
+
+  bag_metadata.horizontalReferenceSystem->definition = (u8 *) malloc (sizeof (u8) * 1024);
+  bag_metadata.horizontalReferenceSystem->type = (u8 *) malloc (sizeof (u8) * 10);
+
+
+  //  BAG metadata verticalReferenceSystem
+
+  bag_metadata.verticalReferenceSystem->definition = (u8 *) malloc (sizeof (u8) * 1024);
+  bag_metadata.verticalReferenceSystem->type = (u8 *) malloc (sizeof (u8) * 10);
+
+
+  return (NVTrue);
+}
+
+
+
+//  Set up the PFM and BAG coordinate reference systems.
+
+uint8_t 
+pfmBagEngine::defineCRS ()
+{
+  //  Make the PFM WKT human readable and set up the proj4 projection.
+
+  OGRSpatialReference pfmSRS;
+  char wkt[8192], pretty[8192], proj4[256];
+  strcpy (wkt, options.pfm_wkt.toLatin1 ());
+  char *ppszPretty, *ppszProj4, *ptr_wkt = wkt;
+
+  pfmSRS.importFromWkt (&ptr_wkt);
+
+  pfmSRS.exportToPrettyWkt (&ppszPretty);
+  pfmSRS.exportToProj4 (&ppszProj4);
+
+  strcpy (proj4, ppszProj4);
+  OGRFree (ppszProj4);
+  strcpy (pfm_proj4, proj4);
+
+
+  if (!(pfm_proj = pj_init_plus (proj4)))
+    {
+      callback->errorMessage (tr ("Error initializing input PFM projection"));
+      return (NVFalse);
+    }
+
+
+  strcpy (pretty, ppszPretty);
+  OGRFree (ppszPretty);
+
+  callback->statusMessage (tr ("PFM WKT : \n%1").arg (QString (pretty)));
+
+
+  //  Make the BAG WKT human readable and setup the output BAG proj4 projection.
+
+  OGRSpatialReference bagSRS;
+  strcpy (wkt, options.bag_wkt.toLatin1 ());
+  ptr_wkt = wkt;
+
+  bagSRS.importFromWkt (&ptr_wkt);
+
+  bagSRS.exportToPrettyWkt (&ppszPretty);
+  bagSRS.exportToProj4 (&ppszProj4);
+
+  strcpy (proj4, ppszProj4);
+  OGRFree (ppszProj4);
+  strcpy (bag_proj4, proj4);
+
+
+  if (!(bag_proj = pj_init_plus (proj4)))
+    {
+      callback->errorMessage (tr ("Error initializing output BAG projection"));
+      return (NVFalse);
+    }
+
+
+  strcpy (pretty, ppszPretty);
+  OGRFree (ppszPretty);
+
+  callback->statusMessage (tr ("BAG WKT : \n%1").arg (QString (pretty)));
+
+
+  //  Check to see if the PFM and BAG CRS are the same.
+
+  io_crs_equal = NVFalse;
+  if (options.pfm_wkt == options.bag_wkt) io_crs_equal = NVTrue;
+
+
+  char hbuffer[1024];
+  char vbuffer[1024];
+
+  strcpy (hbuffer, options.bag_wkt.toLatin1 ());
+
+  strcpy ((char *) bag_metadata.horizontalReferenceSystem->definition, hbuffer);
+  strcpy ((char *) bag_metadata.horizontalReferenceSystem->type, "WKT");
+
+
+  //  Now set the vertical reference
+
+  strcpy ((char *) bag_metadata.verticalReferenceSystem->type, "WKT");
+  if (options.v_datum == 53)
+    {
+      strcpy (vbuffer, "VERT_CS[\"WGS84E Z in meters\",VERT_DATUM[\"Ellipsoid\",2002],UNIT[\"metre\",1],AXIS[\"Z\",UP]]");
+    }
+  else if (options.v_datum == 54)
+    {
+      strcpy (vbuffer, "VERT_CS[\"NAVD88\",VERT_DATUM[\"North American Vertical Datum 1988\",2005,AUTHORITY[\"EPSG\",\"5103\"]],AXIS[\"Gravity-related height\",UP],UNIT[\"metre\",1.0,AUTHORITY[\"EPSG\",\"9001\"]],AUTHORITY[\"EPSG\",\"5703\"]]");
+    }
+  else
+    {
+      strcpy (vbuffer, options.v_datum_name.toLatin1 ());
+      strcpy ((char *) bag_metadata.verticalReferenceSystem->type, "TEXT");
+
+
+      //  Check to see if the user put a VERT_CS WKT string into the "OTHER" option...
+
+      if (options.v_datum_name.startsWith ("VERT_CS"))
+        {
+          OGRSpatialReference vertSRS;
+          char *ptr_wkt = vbuffer;
+
+          if (vertSRS.importFromWkt (&ptr_wkt) == OGRERR_NONE) strcpy ((char *) bag_metadata.verticalReferenceSystem->type, "WKT");
+        }
+    }
+  strcpy ((char *) bag_metadata.verticalReferenceSystem->definition, vbuffer);
+
+  callback->statusMessage (tr ("BAG Vertical Datum : \n%1").arg (QString (vbuffer)));
+
+
+  return (NVTrue);
+}
+
+
+
+//  Define the BAG grid extents (in northings and eastings for UTM output) and the contact metadata.
+
+uint8_t 
+pfmBagEngine::defineGrid ()
+{
+  int32_t pj_status = 0;
+
+
+  //  If we're doing UTM output, set up the area in northings and eastings.
+
+  if (options.bag_wkt.contains ("PROJCS"))
+    {
+      system.coordSys = UTM;
+
+
+      //  Get the min and max northings and eastings.  We're still going to need the actual lat/lon MBR so we store these in proj_mbr.
+      //  Note that we're trying to get the largest extents available.  This is mostly due to distortion in longitude.
+
+      double llx, ulx, lrx, urx, lly, uly, lry, ury;
+
+      llx = mbr.min_x * NV_DEG_TO_RAD;
+      lly = mbr.min_y * NV_DEG_TO_RAD;
+      pj_status = pj_transform (pfm_proj, bag_proj, 1, 1, &llx, &lly, NULL);
+      if (pj_status) return (transformError (pj_status, __LINE__, __FUNCTION__, mbr.min_x, mbr.min_y, llx, lly));
+
+      ulx = mbr.min_x * NV_DEG_TO_RAD;
+      uly = mbr.max_y * NV_DEG_TO_RAD;
+      pj_status = pj_transform (pfm_proj, bag_proj, 1, 1, &ulx, &uly, NULL);
+      if (pj_status) return (transformError (pj_status, __LINE__, __FUNCTION__, mbr.min_x, mbr.max_y, ulx, uly));
+
+      lrx = mbr.max_x * NV_DEG_TO_RAD;
+      lry = mbr.min_y * NV_DEG_TO_RAD;
+      pj_status = pj_transform (pfm_proj, bag_proj, 1, 1, &lrx, &lry, NULL);
+      if (pj_status) return (transformError (pj_status, __LINE__, __FUNCTION__, mbr.max_x, mbr.min_y, lrx, lry));
+
+      urx = mbr.max_x * NV_DEG_TO_RAD;
+      ury = mbr.max_y * NV_DEG_TO_RAD;
+      pj_status = pj_transform (pfm_proj, bag_proj, 1, 1, &urx, &ury, NULL);
+      if (pj_status) return (transformError (pj_status, __LINE__, __FUNCTION__, mbr.max_x, mbr.max_y, urx, ury));
+
+      if (llx < lrx)
+        {
+          proj_mbr.min_x = llx;
+        }
+      else
+        {
+          proj_mbr.min_x = lrx;
+        }
+
+      if (lrx > urx)
+        {
+          proj_mbr.max_x = lrx;
+        }
+      else
+        {
+          proj_mbr.max_x = urx;
+        }
+
+      if (lly < lry)
+        {
+          proj_mbr.min_y = lly;
+        }
+      else
+        {
+          proj_mbr.min_y = lry;
+        }
+
+      if (uly > ury)
+        {
+          proj_mbr.max_y = uly;
+        }
+      else
+        {
+          proj_mbr.max_y = ury;
+        }
+
+
+      bag_metadata.spatialRepresentationInfo->numberOfRows = bag_height = NINT ((proj_mbr.max_y - proj_mbr.min_y) / options.mbin_size + 0.05);
+      bag_metadata.spatialRepresentationInfo->numberOfColumns = bag_width = NINT ((proj_mbr.max_x - proj_mbr.min_x) / options.mbin_size + 0.05);
+
+      bag_metadata.spatialRepresentationInfo->rowResolution = options.mbin_size;
+      bag_metadata.spatialRepresentationInfo->columnResolution = options.mbin_size;
+
+
+      //  Make sure we have an exact number of bins.
+
+      proj_mbr.max_x = proj_mbr.min_x + bag_width * options.mbin_size;
+      proj_mbr.max_y = proj_mbr.min_y + bag_height * options.mbin_size;
+
+
+      //  In order to make the output BAG have corner node (also known as grid) positioning we have to take
+      //  half of a cell size off of the dimensions.  That's all we have to do.  We can still do all computations
+      //  based on center node (also known as pixel) positioning.
+
+      half_x = half_y = options.mbin_size / 2.0;
+
+
+      //  Redefine the geodetic area from the northings and eastings so that projected and unprojected match.
+
+      double x, y;
+
+      x = proj_mbr.max_x - half_x;
+      y = proj_mbr.max_y - half_y;
+      pj_status = pj_transform (bag_proj, pfm_proj, 1, 1, &x, &y, NULL);
+      if (pj_status) return (transformError (pj_status, __LINE__, __FUNCTION__, proj_mbr.max_x - half_x, proj_mbr.max_y - half_y, x, y));
+      mbr.max_x = x * NV_RAD_TO_DEG;
+      mbr.max_y = y * NV_RAD_TO_DEG;
+
+      x = proj_mbr.min_x + half_x;
+      y = proj_mbr.min_y + half_y;
+      pj_status = pj_transform (bag_proj, pfm_proj, 1, 1, &x, &y, NULL);
+      if (pj_status) return (transformError (pj_status, __LINE__, __FUNCTION__, proj_mbr.min_x + half_x, proj_mbr.min_y + half_y, x, y));
+      mbr.min_x = x * NV_RAD_TO_DEG;
+      mbr.min_y = y * NV_RAD_TO_DEG;
+
+      bag_metadata.identificationInfo->westBoundingLongitude = mbr.min_x;
+      bag_metadata.identificationInfo->eastBoundingLongitude = mbr.max_x;
+      bag_metadata.identificationInfo->southBoundingLatitude = mbr.min_y;
+      bag_metadata.identificationInfo->northBoundingLatitude = mbr.max_y;
+
+      bag_metadata.spatialRepresentationInfo->llCornerX = proj_mbr.min_x + half_x;
+      bag_metadata.spatialRepresentationInfo->urCornerX = proj_mbr.max_x - half_x;
+      bag_metadata.spatialRepresentationInfo->llCornerY = proj_mbr.min_y + half_y;
+      bag_metadata.spatialRepresentationInfo->urCornerY = proj_mbr.max_y - half_y;    
+    }
+  else
+    {
+      system.coordSys = Geodetic;
+
+
+      bag_metadata.spatialRepresentationInfo->numberOfRows = bag_height = NINT ((mbr.max_y - mbr.min_y) / y_bin_size_degrees + 0.05);
+      bag_metadata.spatialRepresentationInfo->numberOfColumns = bag_width = NINT ((mbr.max_x - mbr.min_x) / x_bin_size_degrees + 0.05);
+
+      bag_metadata.spatialRepresentationInfo->rowResolution = y_bin_size_degrees;
+      bag_metadata.spatialRepresentationInfo->columnResolution = x_bin_size_degrees;
+
+
+      //  In order to make the output BAG have corner node (also known as grid) positioning we have to take
+      //  half of a cell size off of the dimensions.  That's all we have to do.  We can still do all computations
+      //  based on center node (also known as pixel) positioning.
+
+      half_x = open_args.head.x_bin_size_degrees * 0.5;
+      half_y = open_args.head.y_bin_size_degrees * 0.5;
+
+
+      //  If the output is geodetic but has a different geodetic CRS we have to convert the bounds to the new CRS.
+
+      if (io_crs_equal)
+        {
+          bag_metadata.identificationInfo->westBoundingLongitude = bag_metadata.spatialRepresentationInfo->llCornerX = mbr.min_x + half_x;
+          bag_metadata.identificationInfo->eastBoundingLongitude = bag_metadata.spatialRepresentationInfo->urCornerX = mbr.max_x - half_x;
+          bag_metadata.identificationInfo->southBoundingLatitude = bag_metadata.spatialRepresentationInfo->llCornerY = mbr.min_y + half_y;
+          bag_metadata.identificationInfo->northBoundingLatitude = bag_metadata.spatialRepresentationInfo->urCornerY = mbr.max_y - half_y;
+        }
+      else
+        {
+          double x, y;
+
+          x = mbr.min_x * NV_DEG_TO_RAD;
+          y = mbr.min_y * NV_DEG_TO_RAD;
+          pj_status = pj_transform (pfm_proj, bag_proj, 1, 1, &x, &y, NULL);
+          if (pj_status) return (transformError (pj_status, __LINE__, __FUNCTION__, mbr.min_x, mbr.min_y, x * NV_RAD_TO_DEG, y * NV_RAD_TO_DEG));
+          x *= NV_RAD_TO_DEG;
+          y *= NV_RAD_TO_DEG;
+
+
+          bag_metadata.identificationInfo->westBoundingLongitude = bag_metadata.spatialRepresentationInfo->llCornerX = x + half_x;
+          bag_metadata.identificationInfo->southBoundingLatitude = bag_metadata.spatialRepresentationInfo->llCornerY = y + half_y;
+
+          x = mbr.max_x * NV_DEG_TO_RAD;
+          y = mbr.max_y * NV_DEG_TO_RAD;
+          pj_status = pj_transform (pfm_proj, bag_proj, 1, 1, &x, &y, NULL);
+          if (pj_status) return (transformError (pj_status, __LINE__, __FUNCTION__, mbr.max_x, mbr.max_y, x * NV_RAD_TO_DEG, y * NV_RAD_TO_DEG));
+          x *= NV_RAD_TO_DEG;
+          y *= NV_RAD_TO_DEG;
+
+          bag_metadata.identificationInfo->eastBoundingLongitude = bag_metadata.spatialRepresentationInfo->urCornerX = x - half_x;
+          bag_metadata.identificationInfo->northBoundingLatitude = bag_metadata.spatialRepresentationInfo->urCornerY = y - half_y;
+        }
+    }
+
+
+  //  BAG metadata contact
+
+  bag_metadata.contact->individualName = (u8 *) malloc (sizeof (u8) * options.poc_name.size ());
+  strcpy ((char *) bag_metadata.contact->individualName, options.poc_name.toLatin1 ());
+
+  bag_metadata.contact->organisationName = (u8 *) malloc (sizeof (u8) * options.source.size () + 1);
+  strcpy ((char *) bag_metadata.contact->organisationName, options.source.toLatin1 ());
+
+  bag_metadata.contact->positionName = (u8 *) malloc (sizeof (u8) * options.pi_title.size () + 1);
+  strcpy ((char *) bag_metadata.contact->positionName, options.pi_title.toLatin1 ());
+
+  bag_metadata.contact->role = (u8 *) malloc (sizeof (u8) * 20);
+  strcpy ((char *) bag_metadata.contact->role, tr ("Point of Contact").toLatin1 ());
+
+
+  return (NVTrue);
+}
+
+
+
+//  A range of columns (first through last, in fractional BAG columns) in a BAG row, and a crossing of a polygon edge
+//  with the center line of a BAG row.  Used to rasterize the area polygon.
+
+typedef struct
+{
+  int32_t          row;
+  double           first;
+  double           last;
+} AREA_RANGE;
+
+typedef struct
+{
+  int32_t          row;
+  double           x;
+} AREA_CROSSING;
+
+
+static int32_t 
+compare_ranges (const void *a, const void *b)
+{
+  const AREA_RANGE *ra = (const AREA_RANGE *) a, *rb = (const AREA_RANGE *) b;
+
+  if (ra->row != rb->row) return (ra->row < rb->row ? -1 : 1);
+  if (ra->first != rb->first) return (ra->first < rb->first ? -1 : 1);
+  return (0);
+}
+
+
+static int32_t 
+compare_crossings (const void *a, const void *b)
+{
+  const AREA_CROSSING *ca = (const AREA_CROSSING *) a, *cb = (const AREA_CROSSING *) b;
+
+  if (ca->row != cb->row) return (ca->row < cb->row ? -1 : 1);
+  if (ca->x != cb->x) return (ca->x < cb->x ? -1 : 1);
+  return (0);
+}
+
+
+static uint8_t 
+add_range (AREA_RANGE **range, int32_t *count, int32_t *size, int32_t row, double first, double last)
+{
+  if (*count == *size)
+    {
+      int32_t new_size = qMax (*size * 2, 1024);
+      AREA_RANGE *new_range = (AREA_RANGE *) realloc (*range, new_size * sizeof (AREA_RANGE));
+
+      if (new_range == NULL) return (NVFalse);
+
+      *range = new_range;
+      *size = new_size;
+    }
+
+  (*range)[*count].row = row;
+  (*range)[*count].first = first;
+  (*range)[*count].last = last;
+  (*count)++;
+
+  return (NVTrue);
+}
+
+
+
+//  The area polygon's points in fractional BAG columns and rows as the edges are densified for UTM output.
+
+typedef struct
+{
+  projPJ           pfm_proj, bag_proj;
+  double           min_x, min_y, cell;
+  double           *x, *y;
+  int32_t          count, size, pj_status;
+} AREA_POINTS;
+
+
+static uint8_t 
+add_point (AREA_POINTS *pts, double x, double y)
+{
+  if (pts->count == pts->size)
+    {
+      int32_t new_size = qMax (pts->size * 2, 1024);
+
+      double *new_x = (double *) realloc (pts->x, new_size * sizeof (double));
+      if (new_x) pts->x = new_x;
+      double *new_y = (double *) realloc (pts->y, new_size * sizeof (double));
+      if (new_y) pts->y = new_y;
+
+      if (new_x == NULL || new_y == NULL) return (NVFalse);
+
+      pts->size = new_size;
+    }
+
+  pts->x[pts->count] = x;
+  pts->y[pts->count] = y;
+  pts->count++;
+
+  return (NVTrue);
+}
+
+
+
+/*!
+    The area edges are straight lines in lat/lon so they're curves in the UTM grid.  Add the points that are needed
+    between (lon0, lat0) and (lon1, lat1) (degrees, whose projections are x0, y0 and x1, y1) so that no chord is more
+    than half a cell from the projected edge.  The edge is split in half (in lat/lon) until the projected midpoint is
+    within half a cell of the chord's midpoint.  Only the points between the ends are added, in order.  Returns NVFalse
+    if we run out of memory or the transform fails (pts->pj_status is set).
+*/
+
+static uint8_t 
+densify_edge (AREA_POINTS *pts, double lon0, double lat0, double x0, double y0, double lon1, double lat1, double x1,
+              double y1, int32_t depth)
+{
+  double lon = (lon0 + lon1) * 0.5, lat = (lat0 + lat1) * 0.5;
+  double x = lon * NV_DEG_TO_RAD, y = lat * NV_DEG_TO_RAD;
+
+  if ((pts->pj_status = pj_transform (pts->pfm_proj, pts->bag_proj, 1, 1, &x, &y, NULL))) return (NVFalse);
+
+  x = (x - pts->min_x) / pts->cell;
+  y = (y - pts->min_y) / pts->cell;
+
+
+  //  Close enough (or we've split it as far as we're going to).
+
+  double dx = x - (x0 + x1) * 0.5, dy = y - (y0 + y1) * 0.5;
+
+  if (dx * dx + dy * dy < 0.25 || !depth) return (NVTrue);
+
+
+  if (!densify_edge (pts, lon0, lat0, x0, y0, lon, lat, x, y, depth - 1)) return (NVFalse);
+  if (!add_point (pts, x, y)) return (NVFalse);
+  return (densify_edge (pts, lon, lat, x, y, lon1, lat1, x1, y1, depth - 1));
+}
+
+
+
+/*!
+    Rasterize the area polygon into a list of inside spans for each BAG row so that cells outside of it can be set
+    to NULL without reading the PFM.  A cell is inside if any part of it is inside the polygon.  Each edge marks the
+    cells it passes through and the crossings of the edges with the center line of each row (paired with the even-odd
+    rule) mark the interior.  Together those are exactly the cells that touch the polygon (any column of a row that
+    doesn't contain part of an edge is either all inside or all outside, and its center tells us which).  For UTM
+    output the edges are densified (densify_edge) until the projected polyline is within half a cell of the projected
+    edges and we add a cell all the way around them to make up for what's left.  The edges of all of the rings are
+    used together so multi-part areas and holes work.  Each edge is only handled in the rows it crosses (the ranges
+    and crossings are bucketed by row when they're sorted) so the polygon can be as detailed as you like, and each cell
+    is then checked against its row's spans in constant (amortized) time.
+    <br><br>
+    The spans for row r are mask_span[2 * k] through mask_span[2 * k + 1] for k from mask_row[r] to
+    mask_row[r + 1] - 1.  If there's no area polygon mask_row is left NULL and every cell is inside.
+*/
+
+uint8_t 
+pfmBagEngine::buildAreaMask ()
+{
+  if (area_count < 3) return (NVTrue);
+
+
+  //  Vertices in fractional BAG columns and rows.
+
+  double *vx = (double *) malloc (area_count * sizeof (double));
+  double *vy = (double *) malloc (area_count * sizeof (double));
+
+  if (vx == NULL || vy == NULL)
+    {
+      free (vx);
+      free (vy);
+      return (memoryError ("area vertices", __LINE__, __FUNCTION__));
+    }
+
+  AREA_POINTS pts;
+  int32_t *ring = area_part, points = area_count, margin = 0;
+
+  memset (&pts, 0, sizeof (AREA_POINTS));
+
+  if (system.coordSys == UTM)
+    {
+      for (int32_t i = 0 ; i < area_count ; i++)
+        {
+          vx[i] = area_x[i] * NV_DEG_TO_RAD;
+          vy[i] = area_y[i] * NV_DEG_TO_RAD;
+        }
+
+      int32_t pj_status = pj_transform (pfm_proj, bag_proj, area_count, 1, vx, vy, NULL);
+
+      if (pj_status)
+        {
+          double out_x = vx[0], out_y = vy[0];
+
+          free (vx);
+          free (vy);
+          return (transformError (pj_status, __LINE__, __FUNCTION__, area_x[0], area_y[0], out_x, out_y));
+        }
+
+      for (int32_t i = 0 ; i < area_count ; i++)
+        {
+          vx[i] = (vx[i] - proj_mbr.min_x) / options.mbin_size;
+          vy[i] = (vy[i] - proj_mbr.min_y) / options.mbin_size;
+        }
+
+
+      //  Densify the edges of each ring.
+
+      pts.pfm_proj = pfm_proj;
+      pts.bag_proj = bag_proj;
+      pts.min_x = proj_mbr.min_x;
+      pts.min_y = proj_mbr.min_y;
+      pts.cell = options.mbin_size;
+
+      ring = (int32_t *) malloc ((area_parts + 1) * sizeof (int32_t));
+      uint8_t ok = (ring != NULL);
+
+      for (int32_t p = 0 ; ok && p < area_parts ; p++)
+        {
+          ring[p] = pts.count;
+
+          for (int32_t i = area_part[p] ; ok && i < area_part[p + 1] ; i++)
+            {
+              int32_t k = (i + 1 < area_part[p + 1]) ? i + 1 : area_part[p];
+
+              ok = add_point (&pts, vx[i], vy[i]) &&
+                densify_edge (&pts, area_x[i], area_y[i], vx[i], vy[i], area_x[k], area_y[k], vx[k], vy[k], 16);
+            }
+        }
+
+      free (vx);
+      free (vy);
+
+      if (!ok)
+        {
+          free (ring);
+          free (pts.x);
+          free (pts.y);
+
+          if (pts.pj_status) return (transformError (pts.pj_status, __LINE__, __FUNCTION__, area_x[0], area_y[0], 0.0, 0.0));
+          return (memoryError ("area vertices", __LINE__, __FUNCTION__));
+        }
+
+      ring[area_parts] = pts.count;
+      vx = pts.x;
+      vy = pts.y;
+      points = pts.count;
+
+      margin = 1;
+    }
+  else
+    {
+      for (int32_t i = 0 ; i < area_count ; i++)
+        {
+          vx[i] = (area_x[i] - mbr.min_x) / x_bin_size_degrees;
+          vy[i] = (area_y[i] - mbr.min_y) / y_bin_size_degrees;
+        }
+    }
+
+
+  AREA_RANGE *range = NULL;
+  AREA_CROSSING *crossing = NULL;
+  int32_t range_count = 0, range_size = 0, crossing_count = 0, crossing_size = 0;
+  uint8_t status = NVTrue;
+
+
+  for (int32_t i = 0, part = 0 ; status && i < points ; i++)
+    {
+      //  The edge from vertex i to the next vertex in its ring (the last vertex of a ring goes back to the first).
+
+      while (i >= ring[part + 1]) part++;
+
+      int32_t k = (i + 1 < ring[part + 1]) ? i + 1 : ring[part];
+      double x0 = vx[i], y0 = vy[i], x1 = vx[k], y1 = vy[k];
+
+      if (y0 > y1)
+        {
+          qSwap (x0, x1);
+          qSwap (y0, y1);
+        }
+
+
+      //  The cells that the edge passes through (plus the margin).
+
+      int32_t first_row = qMax ((int32_t) floor (y0) - margin, 0);
+      int32_t last_row = qMin ((int32_t) floor (y1) + margin, bag_height - 1);
+
+      for (int32_t r = first_row ; status && r <= last_row ; r++)
+        {
+          double ya = qMax (y0, (double) (r - margin)), yb = qMin (y1, (double) (r + 1 + margin));
+          double xa = x0, xb = x1;
+
+          if (y1 > y0)
+            {
+              xa = x0 + (x1 - x0) * (qMin (qMax (ya, y0), y1) - y0) / (y1 - y0);
+              xb = x0 + (x1 - x0) * (qMin (qMax (yb, y0), y1) - y0) / (y1 - y0);
+            }
+
+          status = add_range (&range, &range_count, &range_size, r, qMin (xa, xb) - margin, qMax (xa, xb) + margin);
+        }
+
+
+      //  The crossings of the edge with the row center lines (half open so a vertex on a center line counts once).
+
+      first_row = qMax ((int32_t) ceil (y0 - 0.5), 0);
+      last_row = qMin ((int32_t) ceil (y1 - 0.5) - 1, bag_height - 1);
+
+      for (int32_t r = first_row ; status && r <= last_row ; r++)
+        {
+          if (crossing_count == crossing_size)
+            {
+              int32_t new_size = qMax (crossing_size * 2, 1024);
+              AREA_CROSSING *new_crossing = (AREA_CROSSING *) realloc (crossing, new_size * sizeof (AREA_CROSSING));
+
+              if (new_crossing == NULL)
+                {
+                  status = NVFalse;
+                  break;
+                }
+
+              crossing = new_crossing;
+              crossing_size = new_size;
+            }
+
+          double yc = (double) r + 0.5;
+
+          crossing[crossing_count].row = r;
+          crossing[crossing_count].x = x0 + (x1 - x0) * (yc - y0) / (y1 - y0);
+          crossing_count++;
+        }
+    }
+
+  free (vx);
+  free (vy);
+  if (ring != area_part) free (ring);
+
+
+  //  Pair up the crossings in each row to get the interior.
+
+  if (status && crossing_count)
+    {
+      qsort (crossing, crossing_count, sizeof (AREA_CROSSING), compare_crossings);
+
+      for (int32_t i = 0 ; status && i + 1 < crossing_count ; i++)
+        {
+          if (crossing[i].row != crossing[i + 1].row) continue;
+
+          status = add_range (&range, &range_count, &range_size, crossing[i].row, crossing[i].x, crossing[i + 1].x);
+          i++;
+        }
+    }
+
+  free (crossing);
+
+
+  //  Merge the ranges in each row into spans of whole columns.
+
+  if (status)
+    {
+      mask_row = (int32_t *) calloc (bag_height + 1, sizeof (int32_t));
+      mask_span = (int32_t *) malloc (qMax (range_count, 1) * 2 * sizeof (int32_t));
+
+      if (mask_row == NULL || mask_span == NULL) status = NVFalse;
+    }
+
+  if (!status)
+    {
+      free (range);
+      return (memoryError ("area mask", __LINE__, __FUNCTION__));
+    }
+
+
+  qsort (range, range_count, sizeof (AREA_RANGE), compare_ranges);
+
+  int32_t spans = 0, row = -1;
+  int64_t inside = 0;
+
+  for (int32_t i = 0 ; i < range_count ; i++)
+    {
+      if (range[i].last < 0.0 || range[i].first >= (double) bag_width) continue;
+
+      int32_t first = qMax ((int32_t) floor (range[i].first), 0);
+      int32_t last = qMin ((int32_t) floor (range[i].last), bag_width - 1);
+
+      if (range[i].row == row && first <= mask_span[2 * spans - 1] + 1)
+        {
+          mask_span[2 * spans - 1] = qMax (mask_span[2 * spans - 1], last);
+        }
+      else
+        {
+          for (int32_t r = row + 1 ; r <= range[i].row ; r++) mask_row[r] = spans;
+          row = range[i].row;
+
+          mask_span[2 * spans] = first;
+          mask_span[2 * spans + 1] = last;
+          spans++;
+        }
+    }
+
+  for (int32_t r = row + 1 ; r <= bag_height ; r++) mask_row[r] = spans;
+
+  free (range);
+
+
+  for (int32_t k = 0 ; k < spans ; k++) inside += mask_span[2 * k + 1] - mask_span[2 * k] + 1;
+
+  callback->statusMessage (tr ("Area polygon mask, %L1 of %L2 cells inside the polygon").arg (inside).arg
+                           ((int64_t) bag_width * (int64_t) bag_height));
+
+
+  return (NVTrue);
+}
+
+
+
+//  Returns NVTrue if BAG cell row, col is outside of the area polygon.  span is the row's current span (start with
+//  mask_row[row]) and has to be called with increasing columns.
+
+uint8_t 
+pfmBagEngine::outsideArea (int32_t row, int32_t col, int32_t *span)
+{
+  if (mask_row == NULL) return (NVFalse);
+
+  while (*span < mask_row[row + 1] && mask_span[2 * *span + 1] < col) (*span)++;
+
+  return (*span >= mask_row[row + 1] || mask_span[2 * *span] > col);
+}
+
+
+
+//  The first and last columns of rows start_row through start_row + rows - 1 that are inside the area polygon.
+//  Returns NVFalse if none of them are.
+
+uint8_t 
+pfmBagEngine::areaColumns (int32_t start_row, int32_t rows, int32_t *first_col, int32_t *last_col)
+{
+  *first_col = 0;
+  *last_col = bag_width - 1;
+
+  if (mask_row == NULL) return (NVTrue);
+
+  *first_col = bag_width;
+  *last_col = -1;
+
+  for (int32_t r = start_row ; r < start_row + rows ; r++)
+    {
+      if (mask_row[r] == mask_row[r + 1]) continue;
+
+      *first_col = qMin (*first_col, mask_span[2 * mask_row[r]]);
+      *last_col = qMax (*last_col, mask_span[2 * (mask_row[r + 1] - 1) + 1]);
+    }
+
+  return (*last_col >= 0);
+}
+
+
+
+//  Clear the statistics of the cells in a row that are outside of the area polygon so they come out NULL.
+
+void 
+pfmBagEngine::maskRow (int32_t row, CELL_STATS *st)
+{
+  if (mask_row == NULL) return;
+
+  int32_t span = mask_row[row];
+
+  for (int32_t j = 0 ; j < bag_width ; j++)
+    {
+      if (outsideArea (row, j, &span)) clearCell (&st[j]);
+    }
+}
+
+
+
+/*!
+    Build the table of the features that we're going to use (for the weights, the lineage, the tracking list, and the
+    modified nodes).  This is the only place that decides which features are used so everything downstream works from
+    the same list.  Each entry has the position of the feature in lon/lat and in the BAG CRS (easting/northing for UTM
+    output, otherwise the same lon/lat) computed once, its depth, its search radius for the enhanced surface, its
+    parent record, and its record number in the feature file.  The table is in feature file order.  eligible_index
+    maps a feature file record number to its table entry (-1 if it isn't used).
+*/
+
+uint8_t 
+pfmBagEngine::selectFeatures ()
+{
+  int32_t pj_status = 0;
+
+
+  if (!features) return (NVTrue);
+
+
+  eligible = (ELIGIBLE_FEATURE *) malloc (qMax (bfd_header.number_of_records, (uint32_t) 1) * sizeof (ELIGIBLE_FEATURE));
+  eligible_index = (int32_t *) malloc (qMax (bfd_header.number_of_records, (uint32_t) 1) * sizeof (int32_t));
+  if (eligible == NULL || eligible_index == NULL) return (memoryError ("eligible", __LINE__, __FUNCTION__));
+
+
+  for (uint32_t i = 0 ; i < bfd_header.number_of_records ; i++)
+    {
+      eligible_index[i] = -1;
+
+
+      //  Make sure the feature that has been read is inside the bounds of the BAG being built.  Also check the feature type and
+      //  the confidence.  If it is 0 it's invalid.  If it is 2 it was probably set with mosaicView and is non-sonar.  If it's 1
+      //  it's probably not very good.
+
+      if (feature[i].feature_type != BFDATA_HYDROGRAPHIC || feature[i].confidence_level <= 2 ||
+          feature[i].longitude < mbr.min_x || feature[i].longitude > mbr.max_x ||
+          feature[i].latitude < mbr.min_y || feature[i].latitude > mbr.max_y) continue;
+
+
+      ELIGIBLE_FEATURE *ef = &eligible[eligible_count];
+
+      ef->pos.x = feature[i].longitude;
+      ef->pos.y = feature[i].latitude;
+      ef->proj_pos = ef->pos;
+
+      if (system.coordSys == UTM)
+        {
+          double x = feature[i].longitude * NV_DEG_TO_RAD;
+          double y = feature[i].latitude * NV_DEG_TO_RAD;
+          pj_status = pj_transform (pfm_proj, bag_proj, 1, 1, &x, &y, NULL);
+          if (pj_status) return (transformError (pj_status, __LINE__, __FUNCTION__, feature[i].longitude, feature[i].latitude, x, y));
+
+          ef->proj_pos.x = x;
+          ef->proj_pos.y = y;
+        }
+
+      ef->depth = feature[i].depth;
+      ef->radius = enhanced ? feature_radius (feature[i].remarks, options.non_radius) : 0.0;
+      ef->parent = feature[i].parent_record;
+      ef->index = i;
+
+      eligible_index[i] = eligible_count++;
+    }
+
+
+  return (NVTrue);
+}
+
+
+
+//  If we are using the feature file to create an enhanced surface we have to create and populate the weight array.
+
+uint8_t 
+pfmBagEngine::computeWeights ()
+{
+  //  Set up the log array for scaling so we don't have to keep computing powers of ten in the main loop.  Note that I'm
+  //  subtracting 1.0 from the results at 0 and going up to 0.0 at 100.  This is so that the curve is zero based.  It's not
+  //  exactly a log curve but it's pretty darn close.
+
+  for (int32_t i = 0 ; i < 100 ; i++) log_array[i] = pow (10.0L, ((double) i / 100.0)) - (1.0L * ((99.0L - (double) i) / 100.0L));
+
+
+  //  If we are using the feature file to create an enhanced surface we have to create a weight array.
+
+  if (enhanced)
+    {
+      //  Figure out which cells each feature can reach (once, the weight engines and the weight grid all need it).
+
+      feature_cells = (int32_t *) malloc (qMax (eligible_count, 1) * 4 * sizeof (int32_t));
+      if (feature_cells == NULL) return (memoryError ("feature_cells", __LINE__, __FUNCTION__));
+
+      for (int32_t k = 0 ; k < eligible_count ; k++) featureCells (&eligible[k], &feature_cells[k * 4]);
+
+
+      //  Allocate the weight grid.  Only the tiles that the features can reach are allocated, everything else has a
+      //  weight of 0.
+
+      if (!init_weight_grid (&weight, bag_width, bag_height))
+        {
+          callback->errorMessage (tr ("Allocating weight grid memory: %1").arg (strerror (errno)));
+          return (NVFalse);
+        }
+
+      for (int32_t k = 0 ; k < eligible_count ; k++)
+        {
+          int32_t *cells = &feature_cells[k * 4];
+
+          if (cells[0] >= 0 && !add_weight_tiles (&weight, cells[0], cells[1], cells[2], cells[3]))
+            {
+              callback->errorMessage (tr ("Allocating weight grid memory: %1").arg (strerror (errno)));
+              return (NVFalse);
+            }
+        }
+
+      callback->statusMessage (tr ("Weight grid, %L1 of %L2 tiles used").arg (weight.tiles_used).arg
+                               ((int64_t) weight.tiles_wide * weight.tiles_high));
+
+
+      //  For geographic BAGs, set up the local tangent plane distance constants for each row.
+
+      if (system.coordSys != UTM)
+        {
+          geo_rows = (GEO_ROW *) malloc (bag_height * sizeof (GEO_ROW));
+          if (geo_rows == NULL) return (memoryError ("geo_rows", __LINE__, __FUNCTION__));
+
+          for (int32_t i = 0 ; i < bag_height ; i++) geo_row (mbr.min_y + (double) i * y_bin_size_degrees + half_y, &geo_rows[i]);
+        }
+
+
+      //  Populate the weight array using the features.
+
+      uint8_t status;
+
+      if (options.weight_engine == SPLAT_WEIGHTS)
+        {
+          status = splatWeights ();
+        }
+      else
+        {
+          status = gatherWeights ();
+        }
+
+      free (geo_rows);
+      geo_rows = NULL;
+      free (feature_cells);
+      feature_cells = NULL;
+
+      if (!status) return (NVFalse);
+    }
+
+
+  return (NVTrue);
+}
+
+
+
+//  Populate the weight array by gathering the weights of the features that can reach each cell.
+
+uint8_t 
+pfmBagEngine::gatherWeights ()
+{
+  //  Bucket the features so that each cell only has to look at the features that might be close enough to matter.
+
+  if (!buildFeatureIndex ()) return (NVFalse);
+
+
+  uint8_t status = weightBands ();
+
+
+  free (bucket_start);
+  free (bucket_feature);
+  bucket_start = bucket_feature = NULL;
+
+
+  return (status);
+}
+
+
+
+//  Gather the weights of rows start_row through start_row + rows - 1 (this may be running in one of the weight threads).
+
+void 
+pfmBagEngine::gatherBand (WEIGHT_CONTEXT *ctx, int32_t start_row, int32_t rows)
+{
+  double lat = 0.0, lon = 0.0, northing = 0.0, easting = 0.0;
+  NV_F64_COORD2 xy[2] = {{0.0, 0.0}, {0.0, 0.0}};
+
+
+  for (int32_t i = start_row ; i < start_row + rows ; i++)
+    {
+      if (system.coordSys == UTM)
+        {
+          xy[0].y = proj_mbr.min_y + (double) i * options.mbin_size;
+          xy[1].y = xy[0].y + options.mbin_size;
+
+          northing = xy[0].y + half_y;
+        }
+      else
+        {
+          xy[0].y = mbr.min_y + (double) i * y_bin_size_degrees;
+          xy[1].y = xy[0].y + y_bin_size_degrees;
+
+          lat = xy[0].y + half_y;
+        }
+
+      for (int32_t j = 0 ; j < bag_width ; j++)
+        {
+          if (system.coordSys == UTM)
+            {
+              xy[0].x = proj_mbr.min_x + (double) j * options.mbin_size;
+              xy[1].x = xy[0].x + options.mbin_size;
+
+              easting = xy[0].x + half_x;
+            }
+          else
+            {
+              xy[0].x = mbr.min_x + (double) j * x_bin_size_degrees;
+              xy[1].x = xy[0].x + x_bin_size_degrees;
+
+              lon = xy[0].x + half_x;
+            }
+
+          double sum = 0.0;
+          uint8_t hit = NVFalse;
+
+
+          //  Only the features in this cell's bucket can reach it.  They were put in the bucket in feature order so
+          //  the sums (and the weights) are exactly what we'd get by checking every feature.
+
+          int32_t bucket = (i / FEATURE_BUCKET_CELLS) * bucket_width + j / FEATURE_BUCKET_CELLS;
+
+          for (int32_t m = bucket_start[bucket] ; m < bucket_start[bucket + 1] ; m++)
+            {
+              ELIGIBLE_FEATURE *ef = &eligible[bucket_feature[m]];
+
+              //  Simple check first...  If it's in the same bin then we set the sum to 100.0 and move on.  The bin
+              //  corners are in the BAG CRS so we check the projected position.
+
+              if (ef->proj_pos.x >= xy[0].x && ef->proj_pos.x <= xy[1].x && ef->proj_pos.y >= xy[0].y &&
+                  ef->proj_pos.y <= xy[1].y)
+                {
+                  sum = 100.0;
+                  hit = NVTrue;
+                  break;
+                }
+
+
+              //  Now for the more complicated stuff...  We have to compute the distance from the feature to the
+              //  cell center to compute the weight.
+
+              double dist;
+
+              if (system.coordSys == UTM)
+                {
+                  double x = ef->proj_pos.x;
+                  double y = ef->proj_pos.y;
+
+                  dist = sqrt ((northing - y) * (northing - y) + (easting - x) * (easting - x));
+                }
+              else
+                {
+                  //  Local tangent plane distance unless it might not be close enough.
+
+                  dist = geo_distance (&geo_rows[i], lon, ef->pos.y, ef->pos.x);
+
+                  if (geo_needs_exact (&geo_rows[i], ef->pos.y, dist, ef->radius))
+                    pfm_geo_distance (ctx->pfm_handle, lat, lon, ef->pos.y, ef->pos.x, &dist);
+                }
+
+
+              //  If we're less than our prescribed distance away from any feature, we want to use a combination of
+              //  the minimum depth in the bin and the average depth for the bin.  We use a power of ten, or log,
+              //  curve to blend the two depths together.  Linear blending falls off too quickly and leaves you
+              //  with the same old spike sticking up (like we used to have with the tracking list).  The blending
+              //  works by taking 100 percent of the minimum depth in the bin in which the feature is located and
+              //  100 percent of the average depth in bins that are more than the feature search radius away from
+              //  the feature.  As we move away from the feature (but still inside the search radius) we include
+              //  more of the average and less of the minimum (based on the precomputed log curve).  If the search
+              //  radii of two features overlap we add the blended minimum depth components (not to exceed 100 percent).
+              //  If, at any point in the feature comparison for a single bin, we exceed 100 percent we stop doing
+              //  the feature comparison for that bin.  This saves us a bit of time.
+
+              if (dist < ef->radius)
+                {
+                  double percent = dist / ef->radius;
+                  int32_t index = NINT (percent * 100.0);
+
+                  if (index < 100)
+                    {
+                      sum += 100.0 - (log_array[index] * 10.0);
+                      hit = NVTrue;
+                      if (sum >= 100.0) break;
+                    }
+                }
+            }
+
+          if (hit) *weight_cell (&weight, i, j) = qMin (NINT (sum), 100);
+        }
+    }
+}
+
+
+
+/*!
+    Build a bucket index of the features that can affect the weight grid.  The BAG grid is split into square buckets of
+    FEATURE_BUCKET_CELLS cells and each eligible feature is added to every bucket that its search radius (plus a cell
+    of slop) touches.  The eligible feature table entries for bucket b are bucket_feature[bucket_start[b]] through
+    bucket_feature[bucket_start[b + 1] - 1], in feature order.
+*/
+
+uint8_t 
+pfmBagEngine::buildFeatureIndex ()
+{
+  int32_t total = 0;
+  int32_t *range = NULL;
+
+
+  bucket_width = (bag_width + FEATURE_BUCKET_CELLS - 1) / FEATURE_BUCKET_CELLS;
+  bucket_height = (bag_height + FEATURE_BUCKET_CELLS - 1) / FEATURE_BUCKET_CELLS;
+
+  bucket_start = (int32_t *) calloc (bucket_width * bucket_height + 1, sizeof (int32_t));
+  if (bucket_start == NULL) return (memoryError ("bucket_start", __LINE__, __FUNCTION__));
+
+
+  //  Bucket ranges (min col, max col, min row, max row) for each feature, -1 if it isn't going in a bucket.
+
+  range = (int32_t *) malloc (qMax (eligible_count, 1) * 4 * sizeof (int32_t));
+  if (range == NULL) return (memoryError ("range", __LINE__, __FUNCTION__));
+
+
+  for (int32_t k = 0 ; k < eligible_count ; k++)
+    {
+      int32_t *rng = &range[k * 4];
+      int32_t *cells = &feature_cells[k * 4];
+
+      rng[0] = -1;
+
+      if (cells[0] < 0) continue;
+
+
+      rng[0] = cells[0] / FEATURE_BUCKET_CELLS;
+      rng[1] = cells[1] / FEATURE_BUCKET_CELLS;
+      rng[2] = cells[2] / FEATURE_BUCKET_CELLS;
+      rng[3] = cells[3] / FEATURE_BUCKET_CELLS;
+
+
+      //  Count them (offset by one so that the running sum below leaves us with the start of each bucket).
+
+      for (int32_t m = rng[2] ; m <= rng[3] ; m++)
+        {
+          for (int32_t n = rng[0] ; n <= rng[1] ; n++) bucket_start[m * bucket_width + n + 1]++;
+        }
+    }
+
+
+  for (int32_t b = 0 ; b < bucket_width * bucket_height ; b++) bucket_start[b + 1] += bucket_start[b];
+
+  total = bucket_start[bucket_width * bucket_height];
+
+
+  bucket_feature = (int32_t *) malloc (qMax (total, 1) * sizeof (int32_t));
+  if (bucket_feature == NULL)
+    {
+      free (range);
+      return (memoryError ("bucket_feature", __LINE__, __FUNCTION__));
+    }
+
+
+  //  Fill the buckets in feature order.  We use a copy of the starts as the fill pointers.
+
+  int32_t *fill = (int32_t *) malloc ((bucket_width * bucket_height + 1) * sizeof (int32_t));
+  if (fill == NULL)
+    {
+      free (range);
+      return (memoryError ("fill", __LINE__, __FUNCTION__));
+    }
+
+  memcpy (fill, bucket_start, (bucket_width * bucket_height + 1) * sizeof (int32_t));
+
+  for (int32_t k = 0 ; k < eligible_count ; k++)
+    {
+      int32_t *rng = &range[k * 4];
+
+      if (rng[0] < 0) continue;
+
+      for (int32_t m = rng[2] ; m <= rng[3] ; m++)
+        {
+          for (int32_t n = rng[0] ; n <= rng[1] ; n++) bucket_feature[fill[m * bucket_width + n]++] = k;
+        }
+    }
+
+  free (fill);
+  free (range);
+
+
+  return (NVTrue);
+}
+
+
+
+/*!
+    Figure out which cells eligible feature ef can reach.  cells is set to the range of cells (min col, max col, min
+    row, max row) that its search radius (plus a cell of slop) can reach.  cells[0] is set to -1 if its radius
+    doesn't reach the BAG.
+*/
+
+void 
+pfmBagEngine::featureCells (ELIGIBLE_FEATURE *ef, int32_t *cells)
+{
+  double fx, fy, rx, ry, rad = ef->radius;
+
+
+  cells[0] = -1;
+
+
+  //  Position of the feature in BAG cells and its radius in cells.
+
+  if (system.coordSys == UTM)
+    {
+      fx = (ef->proj_pos.x - proj_mbr.min_x) / options.mbin_size;
+      fy = (ef->proj_pos.y - proj_mbr.min_y) / options.mbin_size;
+      rx = ry = rad / options.mbin_size;
+    }
+  else
+    {
+      double lat, lon;
+
+      newgp (ef->pos.y, ef->pos.x, 90.0, rad, &lat, &lon);
+      rx = fabs (lon - ef->pos.x) / x_bin_size_degrees;
+
+      newgp (ef->pos.y, ef->pos.x, 0.0, rad, &lat, &lon);
+      ry = fabs (lat - ef->pos.y) / y_bin_size_degrees;
+
+      fx = (ef->pos.x - mbr.min_x) / x_bin_size_degrees;
+      fy = (ef->pos.y - mbr.min_y) / y_bin_size_degrees;
+    }
+
+
+  cells[0] = qMax ((int32_t) floor (fx - rx) - 1, 0);
+  cells[1] = qMin ((int32_t) floor (fx + rx) + 1, bag_width - 1);
+  cells[2] = qMax ((int32_t) floor (fy - ry) - 1, 0);
+  cells[3] = qMin ((int32_t) floor (fy + ry) + 1, bag_height - 1);
+
+  if (cells[0] > cells[1] || cells[2] > cells[3]) cells[0] = -1;
+}
+
+
+
+/*!
+    Populate the weight array by splatting each feature's search radius onto the cells that it can reach.  This
+    is the feature centric alternative to gatherWeights.  Its cost depends on the number of features and the size
+    of their search radii instead of the size of the BAG.  The cell containing the feature gets 100, the other
+    cells inside the radius get the same log curve blend value as in gatherWeights.  The contributions are rounded
+    and added to the cell weights one feature at a time (never exceeding 100) so the weights may be off by one
+    from the gatherWeights values (which are rounded after summing).
+*/
+
+uint8_t 
+pfmBagEngine::splatWeights ()
+{
+  return (weightBands ());
+}
+
+
+
+/*!
+    Splat the features onto rows start_row through start_row + rows - 1 (this may be running in one of the weight
+    threads).  The contributions are all positive and capped at 100 so the cell weights don't depend on which band
+    (or thread) a feature's rows are splatted in.
+*/
+
+void 
+pfmBagEngine::splatBand (WEIGHT_CONTEXT *ctx, int32_t start_row, int32_t rows)
+{
+  int32_t end_row = start_row + rows - 1;
+
+
+  for (int32_t k = 0 ; k < eligible_count ; k++)
+    {
+      NV_F64_COORD2 pos = eligible[k].proj_pos;
+      double radius = eligible[k].radius;
+      int32_t *cells = &feature_cells[k * 4], home_col, home_row;
+
+      if (cells[0] < 0 || cells[3] < start_row || cells[2] > end_row) continue;
+
+
+      //  The cell that contains the feature.
+
+      if (system.coordSys == UTM)
+        {
+          home_col = (int32_t) floor ((pos.x - proj_mbr.min_x) / options.mbin_size);
+          home_row = (int32_t) floor ((pos.y - proj_mbr.min_y) / options.mbin_size);
+        }
+      else
+        {
+          home_col = (int32_t) floor ((pos.x - mbr.min_x) / x_bin_size_degrees);
+          home_row = (int32_t) floor ((pos.y - mbr.min_y) / y_bin_size_degrees);
+        }
+
+
+      for (int32_t i = qMax (cells[2], start_row) ; i <= qMin (cells[3], end_row) ; i++)
+        {
+          double lat = 0.0, northing = 0.0;
+
+          if (system.coordSys == UTM)
+            {
+              northing = proj_mbr.min_y + (double) i * options.mbin_size + half_y;
+            }
+          else
+            {
+              lat = mbr.min_y + (double) i * y_bin_size_degrees + half_y;
+
+
+              //  Local tangent plane distances to the feature for the whole span of the row.
+
+              geo_row_distances (&geo_rows[i], mbr.min_x + (double) cells[0] * x_bin_size_degrees + half_x, x_bin_size_degrees,
+                                 cells[1] - cells[0] + 1, pos.y, pos.x, ctx->row_dist);
+            }
+
+          for (int32_t j = cells[0] ; j <= cells[1] ; j++)
+            {
+              uint8_t *w = weight_cell (&weight, i, j);
+
+              if (*w >= 100) continue;
+
+              if (i == home_row && j == home_col)
+                {
+                  *w = 100;
+                  continue;
+                }
+
+
+              double dist;
+
+              if (system.coordSys == UTM)
+                {
+                  double easting = proj_mbr.min_x + (double) j * options.mbin_size + half_x;
+
+                  dist = sqrt ((northing - pos.y) * (northing - pos.y) + (easting - pos.x) * (easting - pos.x));
+                }
+              else
+                {
+                  dist = ctx->row_dist[j - cells[0]];
+
+                  if (geo_needs_exact (&geo_rows[i], pos.y, dist, radius))
+                    {
+                      double lon = mbr.min_x + (double) j * x_bin_size_degrees + half_x;
+
+                      pfm_geo_distance (ctx->pfm_handle, lat, lon, pos.y, pos.x, &dist);
+                    }
+                }
+
+
+              if (dist < radius)
+                {
+                  int32_t index = NINT ((dist / radius) * 100.0);
+
+                  if (index < 100) *w = qMin (*w + NINT (100.0 - (log_array[index] * 10.0)), 100);
+                }
+            }
+        }
+    }
+}
+
+
+
+/*!
+    Run the weight engine (gatherBand or splatBand) over bands of WEIGHT_BAND_ROWS rows using the same number of
+    threads as the gridding.  Each band only writes the weights of its own rows and the engines compute each cell
+    the same way no matter which band or thread it's in so the weights are identical to doing it in one pass.  The
+    threads grab the next band that hasn't been done, we just keep track of the progress.  For geographic BAGs each
+    thread needs a PFM handle (for pfm_geo_distance) so the first one uses ours and the rest lease one from the
+    handle pool.
+*/
+
+uint8_t 
+pfmBagEngine::weightBands ()
+{
+  WEIGHT_CONTEXT ctx[MAX_GRID_THREADS];
+  pfmBagWeightThread *weight_thread[MAX_GRID_THREADS];
+  int32_t num_contexts = 0;
+  uint8_t status = NVTrue;
+
+
+  weight_band_count = (bag_height + WEIGHT_BAND_ROWS - 1) / WEIGHT_BAND_ROWS;
+  next_weight_band = weight_bands_done = 0;
+
+
+  int32_t num_threads = options.threads;
+  if (num_threads <= 0) num_threads = QThread::idealThreadCount ();
+  num_threads = qMax (1, qMin (num_threads, qMin (weight_band_count, MAX_GRID_THREADS)));
+
+
+  //  Every thread but the first leases a handle from the pool.
+
+  num_threads = qMin (num_threads, MAX_POOL_HANDLES + 1);
+
+
+  for (int32_t i = 0 ; i < num_threads ; i++)
+    {
+      ctx[i].pfm_handle = -1;
+      ctx[i].leased = NVFalse;
+      ctx[i].row_dist = NULL;
+
+      if (system.coordSys != UTM)
+        {
+          num_contexts++;
+
+          if (i == 0)
+            {
+              ctx[i].pfm_handle = pfm_handle;
+            }
+          else
+            {
+              if ((ctx[i].pfm_handle = leaseHandle (tr ("weight thread"))) < 0)
+                {
+                  status = NVFalse;
+                  break;
+                }
+
+              ctx[i].leased = NVTrue;
+            }
+
+
+          //  A row of tangent plane distances for the splat engine.
+
+          ctx[i].row_dist = (double *) malloc (bag_width * sizeof (double));
+          if (ctx[i].row_dist == NULL)
+            {
+              status = memoryError ("row_dist", __LINE__, __FUNCTION__);
+              break;
+            }
+        }
+    }
+
+
+  if (status)
+    {
+      callback->progressRange (WEIGHT_PROGRESS, 0, weight_band_count);
+
+      if (num_threads == 1)
+        {
+          int32_t start_row, rows;
+
+          while (nextWeightBand (&start_row, &rows))
+            {
+              callback->progressValue (WEIGHT_PROGRESS, weight_bands_done);
+
+              weightBand (&ctx[0], start_row, rows);
+              weightBandDone ();
+            }
+        }
+      else
+        {
+          callback->statusMessage (tr ("Computing weights with %1 threads").arg (num_threads));
+
+
+          for (int32_t i = 0 ; i < num_threads ; i++)
+            {
+              weight_thread[i] = new pfmBagWeightThread (this, &ctx[i]);
+              weight_thread[i]->start ();
+            }
+
+
+          //  Keep the progress bar moving until all of the bands are done.
+
+          grid_mutex.lock ();
+
+          while (weight_bands_done < weight_band_count)
+            {
+              band_ready.wait (&grid_mutex);
+
+              int32_t done = weight_bands_done;
+
+              grid_mutex.unlock ();
+              callback->progressValue (WEIGHT_PROGRESS, done);
+              grid_mutex.lock ();
+            }
+
+          grid_mutex.unlock ();
+
+
+          for (int32_t i = 0 ; i < num_threads ; i++)
+            {
+              weight_thread[i]->wait ();
+              delete weight_thread[i];
+            }
+        }
+
+      callback->progressValue (WEIGHT_PROGRESS, weight_band_count);
+    }
+
+
+  for (int32_t i = 0 ; i < num_contexts ; i++)
+    {
+      if (ctx[i].leased) handle_pool->release (ctx[i].pfm_handle);
+      free (ctx[i].row_dist);
+    }
+
+
+  return (status);
+}
+
+
+
+//  Called by the weight threads to get the next band of rows.  Returns NVFalse when there is nothing left to do.
+
+uint8_t 
+pfmBagEngine::nextWeightBand (int32_t *start_row, int32_t *rows)
+{
+  QMutexLocker lock (&grid_mutex);
+
+  if (next_weight_band >= weight_band_count) return (NVFalse);
+
+  *start_row = next_weight_band++ * WEIGHT_BAND_ROWS;
+  *rows = qMin (WEIGHT_BAND_ROWS, bag_height - *start_row);
+
+  return (NVTrue);
+}
+
+
+
+//  Called by the weight threads when a band of rows is done.
+
+void 
+pfmBagEngine::weightBandDone ()
+{
+  QMutexLocker lock (&grid_mutex);
+
+  weight_bands_done++;
+
+  band_ready.wakeAll ();
+}
+
+
+
+//  Compute the weights of a band of rows with the selected weight engine.
+
+void 
+pfmBagEngine::weightBand (WEIGHT_CONTEXT *ctx, int32_t start_row, int32_t rows)
+{
+  if (options.weight_engine == SPLAT_WEIGHTS)
+    {
+      splatBand (ctx, start_row, rows);
+    }
+  else
+    {
+      gatherBand (ctx, start_row, rows);
+    }
+}
+
+
+
+//  Have to have a processStep for each point in the tracking list if you want to create valid XML descriptions for a tracking list.
+
+uint8_t 
+pfmBagEngine::defineLineage ()
+{
+  //  Use features for tracking list.
+
+  if (features)
+    {
+      //  One process step for each feature in the eligible feature table (valid, in the area, Hydrographic).  Process
+      //  step i describes eligible[i], which is also tracking list item i.
+
+      bag_metadata.dataQualityInfo->numberOfProcessSteps = eligible_count;
+
+      bag_metadata.dataQualityInfo->lineageProcessSteps = (BAG_PROCESS_STEP *) malloc (bag_metadata.dataQualityInfo->numberOfProcessSteps *
+                                                                                       sizeof(BAG_PROCESS_STEP));
+
+      for (uint32_t i = 0 ; i < bag_metadata.dataQualityInfo->numberOfProcessSteps ; i++)
+        {
+          bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources = (BAG_SOURCE *) malloc (sizeof(BAG_SOURCE));
+          bag_metadata.dataQualityInfo->lineageProcessSteps[i].numberOfSources = 1;
+          bag_metadata.dataQualityInfo->lineageProcessSteps[i].numberOfProcessors =1;
+
+          bag_metadata.dataQualityInfo->lineageProcessSteps[i].processors =
+            (BAG_RESPONSIBLE_PARTY *) malloc (bag_metadata.dataQualityInfo->lineageProcessSteps[i].numberOfProcessors * sizeof (BAG_RESPONSIBLE_PARTY));
+
+          for (uint32_t j = 0; j < bag_metadata.dataQualityInfo->lineageProcessSteps[i].numberOfSources ; j++)
+            {
+              bag_metadata.dataQualityInfo->lineageProcessSteps[i].processors[j].individualName = (u8 *) malloc (sizeof (u8) * 128);
+              strcpy ((char *) bag_metadata.dataQualityInfo->lineageProcessSteps[i].processors[j].individualName, "\0");
+              bag_metadata.dataQualityInfo->lineageProcessSteps[i].processors[j].positionName = (u8 *) malloc (sizeof (u8) * 128);
+              strcpy ((char *) bag_metadata.dataQualityInfo->lineageProcessSteps[i].processors[j].positionName, "\0");
+              bag_metadata.dataQualityInfo->lineageProcessSteps[i].processors[j].organisationName = (u8 *) malloc (sizeof (u8) * 128);
+              strcpy ((char *) bag_metadata.dataQualityInfo->lineageProcessSteps[i].processors[j].organisationName, "\0");
+              bag_metadata.dataQualityInfo->lineageProcessSteps[i].processors[j].role = (u8 *) malloc (sizeof (u8) * 52);
+              strcpy ((char *) bag_metadata.dataQualityInfo->lineageProcessSteps[i].processors[j].role, "\0");      
+            }
+
+          bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources->responsibleParties =
+            (BAG_RESPONSIBLE_PARTY *) malloc (bag_metadata.dataQualityInfo->lineageProcessSteps[i].numberOfSources * sizeof (BAG_RESPONSIBLE_PARTY));
+
+          for (uint32_t j = 0; j < bag_metadata.dataQualityInfo->lineageProcessSteps[i].numberOfSources ; j++)
+            {
+              bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].responsibleParties->individualName = (u8 *) malloc (sizeof (u8) * 128);
+              strcpy ((char *) bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].responsibleParties->individualName, "\0");
+              bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].responsibleParties->positionName = (u8 *) malloc (sizeof (u8) * 128);
+              strcpy ((char *) bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].responsibleParties->positionName, "\0");
+              bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].responsibleParties->organisationName =
+                (u8 *) malloc (sizeof (u8) * 128);
+              strcpy ((char *) bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].responsibleParties->organisationName, "\0");
+              bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].responsibleParties->role = (u8 *) malloc (sizeof (u8) * 128);
+              strcpy ((char *) bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].responsibleParties->role, "\0");
+
+              bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].date = (u8 *) malloc (sizeof (u8) * 30);
+              strcpy ((char *) bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].date, "\0");
+
+              bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].dateType = (u8 *) malloc (sizeof (u8) * 30);
+              strcpy ((char *) bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].dateType, "publication");
+
+              bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].description = (u8 *) malloc (sizeof (u8) * 30);
+              strcpy ((char *) bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].description, "NAVO PFM");
+
+              bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].numberOfResponsibleParties =1;
+
+              bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].responsibleParties[0].individualName =
+                (u8 *) malloc (sizeof (u8) * 52);
+              strcpy ((char *) bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].responsibleParties[0].individualName,
+                      "Commander of the NAVY");
+
+              bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].responsibleParties[0].organisationName =
+                (u8 *) malloc (sizeof (u8) * 30);
+              strcpy ((char *) bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].responsibleParties[0].organisationName, "NAVOCEANO");
+
+              bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].responsibleParties[0].positionName = (u8 *) malloc (sizeof (u8) * 30);
+              strcpy ((char *) bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].responsibleParties[0].positionName, " ");
+
+              bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].responsibleParties[0].role = (u8 *) malloc (sizeof (u8) * 30);
+              strcpy ((char *) bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].responsibleParties[0].role, " ");
+
+              bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].title = (u8 *) malloc (sizeof (u8) * 64);
+              strcpy ((char *) bag_metadata.dataQualityInfo->lineageProcessSteps[i].lineageSources[j].title, "pfmBag");
+            }
+
+
+          //  Set the date and time.
+
+          BFDATA_SHORT_FEATURE *feat = &feature[eligible[i].index];
+
+          int32_t year, jday, month, mday, hour, minute;
+          float second;
+          cvtime (feat->event_tv_sec, feat->event_tv_nsec, &year, &jday, &hour, &minute, &second);
+          jday2mday (year, jday, &month, &mday);
+          month++;
+
+          char tmp_string[128];
+          sprintf (tmp_string,  "%04d-%02d-%02dT%02d:%02d:%02dZ", year + 1900, month, mday, hour, minute, NINT (second));
+
+          bag_metadata.dataQualityInfo->lineageProcessSteps[i].dateTime = (u8 *) malloc (sizeof (u8) * strlen (tmp_string) + 1);
+          strcpy ((char *) bag_metadata.dataQualityInfo->lineageProcessSteps[i].dateTime, tmp_string);
+
+
+          //  Put the description and remarks into the XML data.
+
+          QString string0 (feat->description);
+
+          QString string1 (feat->remarks);
+
+          QString string2 ("");
+
+
+          //  If the BFDATA_RECORD "parent_record" field is set to anything other than zero, then it is a child record of the
+          //  (parent_record - 1) feature.  If the parent is in the tracking list we point at its entry, otherwise we fall back
+          //  to the parent's feature record number.
+
+          if (feat->parent_record)
+            {
+              uint32_t parent = feat->parent_record - 1;
+
+              if (parent < bfd_header.number_of_records && eligible_index[parent] >= 0)
+                {
+                  string2 = QString ("Child of tracking list entry #%1").arg (eligible_index[parent]);
+                }
+              else
+                {
+                  string2 = QString ("Child of feature record #%1").arg (parent);
+                }
+            }
+
+
+          QString new_string;
+
+          if (string0.isEmpty () && string1.isEmpty () && string2.isEmpty ())
+            {
+              new_string = "No description available";
+            }
+          else
+            {
+              new_string = string0 + " :: " + string1 + "::" + string2;
+            }
+
+
+          bag_metadata.dataQualityInfo->lineageProcessSteps[i].description = (u8 *) malloc (sizeof (u8) * new_string.size () + 1);
+          strcpy ((char *) bag_metadata.dataQualityInfo->lineageProcessSteps[i].description, new_string.toLatin1 ());
+
+
+          //  Finally, set the trackingId.
+
+          sprintf (tmp_string, "%d", i);
+          bag_metadata.dataQualityInfo->lineageProcessSteps[i].trackingId = (u8 *) malloc (sizeof (u8) * 10);
+          strcpy ((char *) bag_metadata.dataQualityInfo->lineageProcessSteps[i].trackingId, tmp_string);
+        }
+    }
+
+
+  return (NVTrue);
+}
+
+
+
+//  Build the XML metadata and create the BAG file.
+
+uint8_t 
+pfmBagEngine::createBag ()
+{
+  bagError err;
+  u8 name[512];
+
+
+  if (!options.output_file_name.endsWith (".bag")) options.output_file_name.append (".bag");
+
+
+  //  If the output bag already exists we have to remove it.
+
+  if (QFile (options.output_file_name).exists ()) QFile (options.output_file_name).remove ();
+
+
+  strcpy ((char *) name, options.output_file_name.toLatin1 ());
+
+
+  xmlBuffer = (uint8_t *) malloc (sizeof (uint8_t) * XML_METADATA_MAX_LENGTH);
+
+
+  bag_metadata.dataQualityInfo->scope = (u8 *) malloc (sizeof (u8) * 30);
+  strcpy ((char *) bag_metadata.dataQualityInfo->scope, "dataset");
+  err = bagInitDefinition (&data.def, &bag_metadata);
+
+
+  //  Create the XML metadata
+
+  int32_t len = bagExportMetadataToXmlBuffer (&bag_metadata, &xmlBuffer);
+
+
+  //  A new BAG file is being created, so set the correct version on the bagData so we can correctly decode the metadata.
+
+  strcpy ((char *) data.version, BAG_VERSION);
+
+
+  //  Allocate the metadata space.
+
+  data.metadata = (u8 *) malloc ((sizeof (u8)) * (len + 1));
+  strcpy ((char *) data.metadata, (char *) xmlBuffer); 
+
+
+  //  Set data compression.
+
+  data.compressionLevel = 1;
+
+
+  //  Create the BAG file.
+
+  if ((err = bagFileCreate (name, &data, &bag_handle)) != BAG_SUCCESS) return (bagFailure (tr ("Error creating BAG file"), err));
+
+
+  return (NVTrue);
+}
+
+
+
+//  Create the optional datasets, grid the surface one row at a time, and store the rows in the BAG.
+
+uint8_t 
+pfmBagEngine::writeSurface ()
+{
+  bagError err;
+
+
+  bagGetDataPointer (bag_handle)->opt[Elevation_Solution_Group].nrows = bag_height;
+  bagGetDataPointer (bag_handle)->opt[Elevation_Solution_Group].ncols = bag_width;
+
+
+  //  bagCreateElevationSolutionGroup will create the hid_t needed by HDF5 and will store it in
+  //  bagGetDataPointer (bag_handle)->opt[Elevation_Solution_Group].datatype so we don't have to specify it above.
+
+  if ((err = bagCreateElevationSolutionGroup (bag_handle, bagGetDataPointer (bag_handle))) != BAG_SUCCESS)
+    return (bagFailure (tr ("Error creating Elevation Solution Group optional dataset"), err));
+
+
+  if ((err = bagAllocArray (bag_handle, 0, 0, bag_height - 1, bag_width - 1, Elevation_Solution_Group)) != BAG_SUCCESS)
+    return (bagFailure (tr ("Error allocating Elevation Solution Group optional dataset"), err));
+
+
+  //  If we're using the CUBE surface, allocate the cube node array.
+
+  if (options.surface == CUBE_SURFACE)
+    {
+      bagGetDataPointer (bag_handle)->opt[Node_Group].nrows = bag_height;
+      bagGetDataPointer (bag_handle)->opt[Node_Group].ncols = bag_width;
+
+
+      //  bagCreateNodeGroup will create the hid_t needed by HDF5 and will store it in bagGetDataPointer (bag_handle)->opt[Node_Group].datatype
+      //  so we don't have to specify it above.
+
+      if ((err = bagCreateNodeGroup (bag_handle, bagGetDataPointer (bag_handle))) != BAG_SUCCESS)
+        return (bagFailure (tr ("Error creating Node Group optional dataset"), err));
+
+
+      if ((err = bagAllocArray (bag_handle, 0, 0, bag_height - 1, bag_width - 1, Node_Group)) != BAG_SUCCESS)
+        return (bagFailure (tr ("Error allocating Node Group optional dataset"), err));
+    }
+
+
+  //  Store the values in the BAG.
+
+  callback->progressRange (SURFACE_PROGRESS, 0, bag_height);
+
+
+  int32_t num_threads = options.threads;
+  if (num_threads <= 0) num_threads = QThread::idealThreadCount ();
+  num_threads = qMax (1, qMin (num_threads, qMin (bag_height, MAX_GRID_THREADS)));
+
+
+  //  Every gridding thread but the first leases a handle from the pool and, with read ahead on, every one of them
+  //  leases another for its read ahead thread.  They're all leased before any thread starts so they have to fit.
+
+  if (options.prefetch > 0)
+    {
+      num_threads = qMin (num_threads, (MAX_POOL_HANDLES + 1) / 2);
+    }
+  else
+    {
+      num_threads = qMin (num_threads, MAX_POOL_HANDLES + 1);
+    }
+
+
+  //  The CUBE surface comes from the PFM bin records so the scatter engine doesn't apply.
+
+  scatter = (options.grid_engine == SCATTER_GRID && options.surface != CUBE_SURFACE);
+
+
+  //  Page cache hints for the PFM files.  The bands are hinted by the PFM rows that the BAG covers.
+
+  if (options.file_hints)
+    {
+      file_hints = new pfmBagFileHints ();
+
+      if (file_hints->open (open_args.list_path, open_args.head.bin_height))
+        {
+          NV_F64_COORD2 xy[2] = {{mbr.min_x, mbr.min_y}, {mbr.max_x, mbr.max_y}};
+          NV_I32_COORD2 coord[2];
+
+          compute_index_ptr (xy[0], &coord[0], &open_args.head);
+          compute_index_ptr (xy[1], &coord[1], &open_args.head);
+
+          hint_row[0] = qMax (coord[0].y, 0);
+          hint_row[1] = qMin (coord[1].y, open_args.head.bin_height - 1);
+
+          callback->statusMessage (tr ("PFM file read ahead hints, depth file %1").arg
+                                   (file_hints->ndx_loaded ? tr ("requested in full") : tr ("read on demand")));
+        }
+      else
+        {
+          delete file_hints;
+          file_hints = NULL;
+
+          callback->warningMessage (tr ("Unable to open the PFM bin and depth files for read ahead hints, continuing without them"));
+        }
+    }
+
+
+  //  The surface is gridded in bands of band_rows rows.  When we're using threads there are two band buffers per
+  //  thread (plenty to keep the threads busy while we're writing), otherwise there's one.  The scatter engine also
+  //  needs a band of cell statistics for each thread.  If the rows are very wide we'll use shorter bands so that we
+  //  don't use a ridiculous amount of memory.
+
+  size_t row_bytes = (size_t) bag_width * (2 * sizeof (float) + sizeof (bagOptElevationSolutionGroup));
+  if (options.surface == CUBE_SURFACE) row_bytes += (size_t) bag_width * sizeof (bagOptNodeGroup);
+
+  size_t stats_bytes = 0;
+  if (scatter) stats_bytes = (size_t) bag_width * sizeof (CELL_STATS);
+
+  band_slots = 1;
+  if (num_threads > 1) band_slots = num_threads * 2;
+
+  band_rows = GRID_BAND_ROWS;
+  while (band_rows > 1 && (size_t) band_rows * (band_slots * row_bytes + num_threads * stats_bytes) > GRID_BAND_MEMORY) band_rows /= 2;
+
+
+  if (num_threads > 1)
+    {
+      if (!gridBands (num_threads)) return (NVFalse);
+    }
+  else
+    {
+      GRID_CONTEXT ctx;
+      uint8_t status = NVTrue;
+      int32_t size = band_rows * bag_width;
+
+
+      //  Allocate the band arrays.
+
+      elevation = (float *) calloc (size, sizeof (float));
+      if (elevation == NULL) return (memoryError ("elevation", __LINE__, __FUNCTION__));
+
+      uncert = (float *) calloc (size, sizeof (float));
+      if (uncert == NULL) return (memoryError ("uncertainty", __LINE__, __FUNCTION__));
+
+      optsol = (bagOptElevationSolutionGroup *) calloc (size, sizeof (bagOptElevationSolutionGroup));
+      if (optsol == NULL) return (memoryError ("optional elevation solution group", __LINE__, __FUNCTION__));
+
+      if (options.surface == CUBE_SURFACE)
+        {
+          cube = (bagOptNodeGroup *) calloc (size, sizeof (bagOptNodeGroup));
+          if (cube == NULL) return (memoryError ("cube node", __LINE__, __FUNCTION__));
+        }
+
+
+      if (!openGridContext (&ctx, NVTrue)) return (NVFalse);
+
+
+      //  Loop for the height of the PFM a band at a time.
+
+      for (int32_t start_row = 0 ; status && start_row < bag_height ; start_row += band_rows)
+        {
+          int32_t rows = qMin (band_rows, bag_height - start_row);
+
+          callback->progressValue (SURFACE_PROGRESS, start_row);
+
+          status = gridBand (&ctx, start_row, rows, elevation, uncert, optsol, cube);
+
+          for (int32_t i = 0 ; status && i < rows ; i++)
+            {
+              int32_t offset = i * bag_width;
+
+              status = writeRow (start_row + i, &elevation[offset], &uncert[offset], &optsol[offset], cube ? &cube[offset] : NULL);
+            }
+        }
+
+      closeGridContext (&ctx);
+
+      if (!status) return (NVFalse);
+    }
+
+
+  if (system.coordSys == UTM && options.approx_error > 0.0)
+    callback->statusMessage (tr ("Approximate cell corner transforms, maximum estimated error %L1 meters (%L2 allowed)").arg
+                             (approx_error, 0, 'f', 4).arg (options.approx_error, 0, 'f', 4));
+
+  if (cache_hits || cache_misses)
+    callback->statusMessage (tr ("Depth array cache, %L1 hits, %L2 misses (%3 MB per thread)").arg (cache_hits).arg (cache_misses).arg
+                             (options.depth_cache));
+
+  if (prefetched) callback->statusMessage (tr ("Read ahead, %L1 depth arrays prefetched").arg (prefetched));
+
+  if (handle_pool->opened) callback->statusMessage (tr ("PFM handle pool, %1 handles opened").arg (handle_pool->opened));
+
+  if (!scatter && options.surface != CUBE_SURFACE)
+    callback->statusMessage (tr ("Sounding filter kernel, %1").arg (sounding_kernel ()));
+
+
+  //  We're done with the weights and the band arrays.
+
+  free_weight_grid (&weight);
+
+  free (elevation);
+  free (uncert);
+  free (optsol);
+  free (cube);
+  elevation = uncert = NULL;
+  optsol = NULL;
+  cube = NULL;
+
+
+  callback->progressValue (SURFACE_PROGRESS, bag_height);
+
+
+  return (NVTrue);
+}
+
+
+
+/*!
+    Grid the surface using num_threads gridding threads.  The rows are split up into bands of band_rows rows.  The
+    threads grab the next band that hasn't been gridded, grid it into one of the band_slots band buffers, and mark
+    it ready.  We write the bands to the BAG in order as they become ready (the BAG API isn't thread safe so all
+    of the writing has to be done here).  A thread can't start a band until the band that last used its buffer has
+    been written so the memory used is bounded by band_slots no matter how far ahead of the writer the threads get.
+*/
+
+uint8_t 
+pfmBagEngine::gridBands (int32_t num_threads)
+{
+  GRID_CONTEXT ctx[MAX_GRID_THREADS];
+  pfmBagGridThread *grid_thread[MAX_GRID_THREADS];
+  int32_t num_contexts = 0;
+  uint8_t status = NVTrue;
+
+
+  band_count = (bag_height + band_rows - 1) / band_rows;
+  next_band = write_band = 0;
+  grid_abort = NVFalse;
+
+
+  band = (GRID_BAND *) calloc (band_slots, sizeof (GRID_BAND));
+  if (band == NULL) return (memoryError ("band", __LINE__, __FUNCTION__));
+
+  for (int32_t i = 0 ; i < band_slots ; i++)
+    {
+      int32_t size = band_rows * bag_width;
+
+      band[i].elevation = (float *) calloc (size, sizeof (float));
+      band[i].uncert = (float *) calloc (size, sizeof (float));
+      band[i].optsol = (bagOptElevationSolutionGroup *) calloc (size, sizeof (bagOptElevationSolutionGroup));
+      if (options.surface == CUBE_SURFACE) band[i].cube = (bagOptNodeGroup *) calloc (size, sizeof (bagOptNodeGroup));
+
+      if (band[i].elevation == NULL || band[i].uncert == NULL || band[i].optsol == NULL ||
+          (options.surface == CUBE_SURFACE && band[i].cube == NULL))
+        {
+          status = memoryError ("band", __LINE__, __FUNCTION__);
+          break;
+        }
+    }
+
+
+  //  The first thread uses our PFM handle and projections, the rest have to open their own.
+
+  if (status)
+    {
+      for (int32_t i = 0 ; i < num_threads ; i++)
+        {
+          if (!openGridContext (&ctx[i], i == 0))
+            {
+              status = NVFalse;
+              break;
+            }
+
+          num_contexts++;
+        }
+    }
+
+
+  if (status)
+    {
+      callback->statusMessage (tr ("Gridding with %1 threads").arg (num_threads));
+
+
+      for (int32_t i = 0 ; i < num_threads ; i++)
+        {
+          grid_thread[i] = new pfmBagGridThread (this, &ctx[i]);
+          grid_thread[i]->start ();
+        }
+
+
+      for (int32_t b = 0 ; b < band_count ; b++)
+        {
+          GRID_BAND *bnd = &band[b % band_slots];
+
+
+          //  Wait for the band to be gridded.
+
+          grid_mutex.lock ();
+
+          while (!bnd->ready && !grid_abort) band_ready.wait (&grid_mutex);
+
+          if (grid_abort) status = NVFalse;
+
+          grid_mutex.unlock ();
+
+          if (!status) break;
+
+
+          callback->progressValue (SURFACE_PROGRESS, bnd->start_row);
+
+          for (int32_t i = 0 ; i < bnd->rows ; i++)
+            {
+              int32_t offset = i * bag_width;
+
+              if (!writeRow (bnd->start_row + i, &bnd->elevation[offset], &bnd->uncert[offset], &bnd->optsol[offset],
+                             bnd->cube ? &bnd->cube[offset] : NULL))
+                {
+                  status = NVFalse;
+                  break;
+                }
+            }
+
+
+          //  Free up the band buffer for the next band that will use it.
+
+          grid_mutex.lock ();
+
+          if (!status) grid_abort = NVTrue;
+
+          bnd->ready = NVFalse;
+          write_band++;
+
+          band_free.wakeAll ();
+
+          grid_mutex.unlock ();
+
+          if (!status) break;
+        }
+
+
+      for (int32_t i = 0 ; i < num_threads ; i++)
+        {
+          grid_thread[i]->wait ();
+          delete grid_thread[i];
+        }
+    }
+
+
+  for (int32_t i = 0 ; i < num_contexts ; i++) closeGridContext (&ctx[i]);
+
+  for (int32_t i = 0 ; i < band_slots ; i++)
+    {
+      free (band[i].elevation);
+      free (band[i].uncert);
+      free (band[i].optsol);
+      free (band[i].cube);
+    }
+
+  free (band);
+  band = NULL;
+
+
+  return (status);
+}
+
+
+
+//  Set up a gridding context.  If shared is set we use the engine's PFM handle and projections, otherwise we lease
+//  a PFM handle from the handle pool and initialize the projections for this context.
+
+uint8_t 
+pfmBagEngine::openGridContext (GRID_CONTEXT *ctx, uint8_t shared)
+{
+  ctx->shared = shared;
+  ctx->pfm_handle = -1;
+  ctx->pfm_proj = ctx->bag_proj = NULL;
+
+  for (int32_t i = 0 ; i < 2 ; i++)
+    {
+      ctx->corner_row[i] = -1;
+      ctx->corner_x[i] = ctx->corner_y[i] = NULL;
+    }
+
+  ctx->approx_error = 0.0;
+  ctx->stats = NULL;
+  ctx->sounding_x = ctx->sounding_y = NULL;
+  ctx->sounding_size = 0;
+  ctx->depth_cache = NULL;
+  ctx->prefetch = NULL;
+  ctx->prefetch_handle = -1;
+  ctx->prefetch_range = NULL;
+  ctx->prefetch_range_size = 0;
+
+
+  if (shared)
+    {
+      ctx->pfm_handle = pfm_handle;
+      ctx->pfm_proj = pfm_proj;
+      ctx->bag_proj = bag_proj;
+    }
+  else
+    {
+      if ((ctx->pfm_handle = leaseHandle (tr ("gridding thread"))) < 0) return (NVFalse);
+
+
+      if (!(ctx->pfm_proj = pj_init_plus (pfm_proj4)) || !(ctx->bag_proj = pj_init_plus (bag_proj4)))
+        {
+          closeGridContext (ctx);
+          callback->errorMessage (tr ("Error initializing projections for gridding thread"));
+          return (NVFalse);
+        }
+    }
+
+
+  //  Cell corner rows for UTM output.
+
+  if (system.coordSys == UTM)
+    {
+      for (int32_t i = 0 ; i < 2 ; i++)
+        {
+          ctx->corner_x[i] = (double *) malloc ((bag_width + 1) * sizeof (double));
+          ctx->corner_y[i] = (double *) malloc ((bag_width + 1) * sizeof (double));
+
+          if (ctx->corner_x[i] == NULL || ctx->corner_y[i] == NULL)
+            {
+              closeGridContext (ctx);
+              return (memoryError ("corner", __LINE__, __FUNCTION__));
+            }
+        }
+    }
+
+
+  //  Depth array cache (and read ahead thread) for the gather engine.
+
+  if (!scatter && options.surface != CUBE_SURFACE)
+    {
+      if (options.prefetch > 0)
+        {
+          if ((ctx->prefetch_handle = leaseHandle (tr ("read ahead thread"))) < 0)
+            {
+              closeGridContext (ctx);
+              return (NVFalse);
+            }
+
+
+          //  The read ahead thread can read any PFM column that the BAG covers (prefetchRows tells it which ones are
+          //  inside the area polygon).
+
+          NV_F64_COORD2 xy[2] = {{mbr.min_x, mbr.min_y}, {mbr.max_x, mbr.max_y}};
+          NV_I32_COORD2 coord[2];
+
+          compute_index_ptr (xy[0], &coord[0], &open_args.head);
+          compute_index_ptr (xy[1], &coord[1], &open_args.head);
+
+          ctx->prefetch = new pfmBagPrefetchThread (ctx->prefetch_handle, qMax (coord[0].x - 1, 0),
+                                                    qMin (coord[1].x + 1, open_args.head.bin_width - 1));
+          ctx->prefetch->start ();
+        }
+
+      ctx->depth_cache = new pfmBagDepthCache (ctx->pfm_handle, options.depth_cache, ctx->prefetch);
+    }
+
+
+  //  Cell statistics for the scatter engine.
+
+  if (scatter)
+    {
+      ctx->stats = (CELL_STATS *) malloc ((size_t) band_rows * bag_width * sizeof (CELL_STATS));
+
+      if (ctx->stats == NULL)
+        {
+          closeGridContext (ctx);
+          return (memoryError ("cell statistics", __LINE__, __FUNCTION__));
+        }
+    }
+
+
+  return (NVTrue);
+}
+
+
+
+void 
+pfmBagEngine::closeGridContext (GRID_CONTEXT *ctx)
+{
+  approx_error = qMax (approx_error, ctx->approx_error);
+
+  if (ctx->prefetch)
+    {
+      ctx->prefetch->stop ();
+      ctx->prefetch->wait ();
+      prefetched += ctx->prefetch->prefetched;
+      delete ctx->prefetch;
+      ctx->prefetch = NULL;
+    }
+
+  handle_pool->release (ctx->prefetch_handle);
+  ctx->prefetch_handle = -1;
+
+  free (ctx->prefetch_range);
+  ctx->prefetch_range = NULL;
+  ctx->prefetch_range_size = 0;
+
+  if (ctx->depth_cache)
+    {
+      cache_hits += ctx->depth_cache->hits;
+      cache_misses += ctx->depth_cache->misses;
+      delete ctx->depth_cache;
+      ctx->depth_cache = NULL;
+    }
+
+  if (!ctx->shared)
+    {
+      handle_pool->release (ctx->pfm_handle);
+      if (ctx->pfm_proj) pj_free (ctx->pfm_proj);
+      if (ctx->bag_proj) pj_free (ctx->bag_proj);
+    }
+
+  ctx->pfm_handle = -1;
+  ctx->pfm_proj = ctx->bag_proj = NULL;
+
+  for (int32_t i = 0 ; i < 2 ; i++)
+    {
+      free (ctx->corner_x[i]);
+      free (ctx->corner_y[i]);
+      ctx->corner_x[i] = ctx->corner_y[i] = NULL;
+      ctx->corner_row[i] = -1;
+    }
+
+  free (ctx->stats);
+  free (ctx->sounding_x);
+  free (ctx->sounding_y);
+  ctx->stats = NULL;
+  ctx->sounding_x = ctx->sounding_y = NULL;
+  ctx->sounding_size = 0;
+
+}
+
+
+/*!
+    Tell the context's read ahead thread that we're working on BAG row start_row and that we'll want the PFM rows
+    that cover BAG rows up to end_row soon.  For UTM output the latitude range of the rows comes from the ends and
+    middle of their lower and upper boundaries.  If there's an area polygon we only want the PFM columns that cover
+    the inside spans of those rows (cells outside of it are never read).  For UTM output the longitude range of a
+    span comes from its ends on the lower and upper boundaries, plus a column either side for the curvature of the
+    rows.  If we can't transform them we just don't read ahead, gridRow will report the error when it gets there.
+*/
+
+void 
+pfmBagEngine::prefetchRows (GRID_CONTEXT *ctx, int32_t start_row, int32_t end_row)
+{
+  NV_F64_COORD2 xy[2];
+  NV_I32_COORD2 coord[2];
+
+
+  end_row = qMin (end_row, bag_height - 1);
+
+  xy[0].x = xy[1].x = mbr.min_x;
+
+  if (system.coordSys == UTM)
+    {
+      xy[0].y = 90.0;
+      xy[1].y = -90.0;
+
+      for (int32_t i = 0 ; i < 2 ; i++)
+        {
+          double py = proj_mbr.min_y + (double) (i ? end_row + 1 : start_row) * options.mbin_size;
+
+          for (int32_t j = 0 ; j < 3 ; j++)
+            {
+              double x = proj_mbr.min_x + (double) j * 0.5 * (proj_mbr.max_x - proj_mbr.min_x), y = py;
+
+              if (pj_transform (ctx->bag_proj, ctx->pfm_proj, 1, 1, &x, &y, NULL)) return;
+
+              xy[0].y = qMin (xy[0].y, y * NV_RAD_TO_DEG);
+              xy[1].y = qMax (xy[1].y, y * NV_RAD_TO_DEG);
+            }
+        }
+    }
+  else
+    {
+      xy[0].y = mbr.min_y + (double) start_row * y_bin_size_degrees;
+      xy[1].y = mbr.min_y + (double) (end_row + 1) * y_bin_size_degrees;
+    }
+
+  compute_index_ptr (xy[0], &coord[0], &open_args.head);
+  compute_index_ptr (xy[1], &coord[1], &open_args.head);
+
+  int32_t first_row = qMax (coord[0].y - 1, 0), last_row = qMin (coord[1].y + 1, open_args.head.bin_height - 1);
+
+
+  if (mask_row == NULL)
+    {
+      ctx->prefetch->request (first_row, last_row, NULL, 0);
+      return;
+    }
+
+
+  //  The PFM column ranges of the inside spans of the rows (possibly none, but the array has to exist so the thread
+  //  doesn't read every column).  If we can't make room for them we do read every column.
+
+  int32_t ranges = mask_row[end_row + 1] - mask_row[start_row];
+
+  if (ranges > ctx->prefetch_range_size || ctx->prefetch_range == NULL)
+    {
+      int32_t *new_range = (int32_t *) realloc (ctx->prefetch_range, qMax (ranges, 1) * 2 * sizeof (int32_t));
+
+      if (new_range == NULL)
+        {
+          ctx->prefetch->request (first_row, last_row, NULL, 0);
+          return;
+        }
+
+      ctx->prefetch_range = new_range;
+      ctx->prefetch_range_size = qMax (ranges, 1);
+    }
+
+
+  for (int32_t k = mask_row[start_row] ; k < mask_row[end_row + 1] ; k++)
+    {
+      int32_t first_col = mask_span[2 * k], last_col = mask_span[2 * k + 1];
+      int32_t *range = &ctx->prefetch_range[2 * (k - mask_row[start_row])];
+
+      if (system.coordSys == UTM)
+        {
+          double min_lon = 180.0, max_lon = -180.0;
+
+          for (int32_t i = 0 ; i < 2 ; i++)
+            {
+              double py = proj_mbr.min_y + (double) (i ? end_row + 1 : start_row) * options.mbin_size;
+
+              for (int32_t j = 0 ; j < 2 ; j++)
+                {
+                  double x = proj_mbr.min_x + (double) (j ? last_col + 1 : first_col) * options.mbin_size, y = py;
+
+                  if (pj_transform (ctx->bag_proj, ctx->pfm_proj, 1, 1, &x, &y, NULL)) return;
+
+                  min_lon = qMin (min_lon, x * NV_RAD_TO_DEG);
+                  max_lon = qMax (max_lon, x * NV_RAD_TO_DEG);
+                }
+            }
+
+          xy[0].x = min_lon;
+          xy[1].x = max_lon;
+        }
+      else
+        {
+          //  The same arithmetic as gridRow so we get the same columns.
+
+          xy[0].x = mbr.min_x + (double) first_col * x_bin_size_degrees;
+          xy[1].x = mbr.min_x + (double) last_col * x_bin_size_degrees + x_bin_size_degrees;
+        }
+
+      compute_index_ptr (xy[0], &coord[0], &open_args.head);
+      compute_index_ptr (xy[1], &coord[1], &open_args.head);
+
+      range[0] = coord[0].x;
+      range[1] = coord[1].x;
+
+      if (system.coordSys == UTM)
+        {
+          range[0]--;
+          range[1]++;
+        }
+    }
+
+  ctx->prefetch->request (first_row, last_row, ctx->prefetch_range, ranges);
+}
+
+
+
+/*!
+    Ask for the part of the PFM bin file that covers this band and the next one.  The PFM rows are interpolated
+    linearly from the PFM rows that the BAG covers (hint_row) so this doesn't need a projection and is close enough
+    for UTM output.
+*/
+
+void 
+pfmBagEngine::hintBand (int32_t start_row, int32_t rows)
+{
+  int32_t pfm_rows = hint_row[1] - hint_row[0] + 1;
+  int32_t end_row = qMin (start_row + 2 * rows, bag_height);
+
+  int32_t first = hint_row[0] + (int32_t) ((int64_t) pfm_rows * start_row / bag_height);
+  int32_t last = hint_row[0] + (int32_t) ((int64_t) pfm_rows * end_row / bag_height);
+
+  file_hints->willNeed (first, last);
+}
+
+
+
+/*!
+    Make sure that the cell corners along row boundary "boundary" (i.e. the bottom edge of BAG row "boundary") are in
+    one of the context's corner arrays and return its index in slot.  If we have to transform them we'll overwrite
+    the array that isn't holding boundary "keep".  All bag_width + 1 corners are transformed with one call to
+    pj_transform.  Since gridRow needs boundaries row and row + 1, a thread working its way up a band of rows only
+    has to transform one new row of corners per row instead of two corners per cell.
+*/
+
+uint8_t 
+pfmBagEngine::cellCorners (GRID_CONTEXT *ctx, int32_t boundary, int32_t keep, int32_t *slot)
+{
+  int32_t pj_status = 0;
+
+
+  for (int32_t i = 0 ; i < 2 ; i++)
+    {
+      if (ctx->corner_row[i] == boundary)
+        {
+          *slot = i;
+          return (NVTrue);
+        }
+    }
+
+
+  *slot = 0;
+  if (ctx->corner_row[0] == keep) *slot = 1;
+
+  double *x = ctx->corner_x[*slot];
+  double *y = ctx->corner_y[*slot];
+  double py = proj_mbr.min_y + (double) boundary * options.mbin_size;
+
+  for (int32_t j = 0 ; j <= bag_width ; j++)
+    {
+      x[j] = proj_mbr.min_x + (double) j * options.mbin_size;
+      y[j] = py;
+    }
+
+  ctx->corner_row[*slot] = -1;
+
+
+  //  If we're allowed some error we transform the end points exactly and let approxCorners fill in the rest.
+
+  if (options.approx_error > 0.0 && bag_width > 1)
+    {
+      pj_status = pj_transform (ctx->bag_proj, ctx->pfm_proj, 1, 1, &x[0], &y[0], NULL);
+      if (pj_status) return (transformError (pj_status, __LINE__, __FUNCTION__, proj_mbr.min_x, py, x[0], y[0]));
+
+      pj_status = pj_transform (ctx->bag_proj, ctx->pfm_proj, 1, 1, &x[bag_width], &y[bag_width], NULL);
+      if (pj_status) return (transformError (pj_status, __LINE__, __FUNCTION__, proj_mbr.max_x, py, x[bag_width], y[bag_width]));
+
+      if (!approxCorners (ctx, x, y, py, 0, bag_width)) return (NVFalse);
+    }
+  else
+    {
+      pj_status = pj_transform (ctx->bag_proj, ctx->pfm_proj, bag_width + 1, 1, x, y, NULL);
+    }
+
+
+  //  When transforming more than one point proj4 flags points that can't be transformed with HUGE_VAL instead of
+  //  returning an error so we have to check.  We redo the bad point by itself to get the error status.
+
+  for (int32_t j = 0 ; j <= bag_width ; j++)
+    {
+      if (pj_status || x[j] == HUGE_VAL || y[j] == HUGE_VAL)
+        {
+          double in_x = proj_mbr.min_x + (double) j * options.mbin_size;
+          double tx = in_x, ty = py;
+
+          if (!pj_status) pj_status = pj_transform (ctx->bag_proj, ctx->pfm_proj, 1, 1, &tx, &ty, NULL);
+
+
+          //  If it worked by itself (it shouldn't) we'll call it a "latitude or longitude exceeded limits" error.
+
+          if (!pj_status) pj_status = -14;
+
+          return (transformError (pj_status, __LINE__, __FUNCTION__, in_x, py, tx * NV_RAD_TO_DEG, ty * NV_RAD_TO_DEG));
+        }
+
+      x[j] *= NV_RAD_TO_DEG;
+      y[j] *= NV_RAD_TO_DEG;
+    }
+
+  ctx->corner_row[*slot] = boundary;
+
+
+  return (NVTrue);
+}
+
+
+
+/*!
+    Approximate transformer for a row of cell corners (this is basically what GDAL's approximate transformer does).
+    x[start], y[start], x[end], and y[end] have already been transformed.  We transform the middle point exactly and
+    compare it to the value interpolated from the end points.  If the difference is less than options.approx_error
+    meters we linearly interpolate the rest of the points on each side of the middle, otherwise we split the segment
+    in half and try again.  The largest difference that we accepted is saved in the context so that it can be
+    reported.  Everything is in radians on the way in and out.
+*/
+
+uint8_t 
+pfmBagEngine::approxCorners (GRID_CONTEXT *ctx, double *x, double *y, double py, int32_t start, int32_t end)
+{
+  int32_t pj_status = 0;
+
+
+  if (end - start < 2) return (NVTrue);
+
+
+  int32_t middle = (start + end) / 2;
+  double in_x = proj_mbr.min_x + (double) middle * options.mbin_size;
+
+  x[middle] = in_x;
+  y[middle] = py;
+
+  pj_status = pj_transform (ctx->bag_proj, ctx->pfm_proj, 1, 1, &x[middle], &y[middle], NULL);
+  if (pj_status) return (transformError (pj_status, __LINE__, __FUNCTION__, in_x, py, x[middle], y[middle]));
+
+
+  //  Difference (in meters, close enough) between the exact middle point and the interpolated one.
+
+  double frac = (double) (middle - start) / (double) (end - start);
+  double dx = (x[start] + (x[end] - x[start]) * frac - x[middle]) * NV_A0 * cos (y[middle]);
+  double dy = (y[start] + (y[end] - y[start]) * frac - y[middle]) * NV_A0;
+  double err = sqrt (dx * dx + dy * dy);
+
+  if (err > options.approx_error)
+    {
+      if (!approxCorners (ctx, x, y, py, start, middle)) return (NVFalse);
+      return (approxCorners (ctx, x, y, py, middle, end));
+    }
+
+
+  ctx->approx_error = qMax (ctx->approx_error, err);
+
+  for (int32_t j = start + 1 ; j < end ; j++)
+    {
+      if (j == middle) continue;
+
+      int32_t j0 = start, j1 = middle;
+      if (j > middle)
+        {
+          j0 = middle;
+          j1 = end;
+        }
+
+      frac = (double) (j - j0) / (double) (j1 - j0);
+      x[j] = x[j0] + (x[j1] - x[j0]) * frac;
+      y[j] = y[j0] + (y[j1] - y[j0]) * frac;
+    }
+
+
+  return (NVTrue);
+}
+
+
+
+//  Called by the gridding threads to get the next band to grid.  Returns NVFalse when there is nothing left to do.
+
+uint8_t 
+pfmBagEngine::nextBand (int32_t *band_num)
+{
+  QMutexLocker lock (&grid_mutex);
+
+
+  //  Wait until the band buffer that we're going to use has been written.
+
+  while (!grid_abort && next_band < band_count && next_band >= write_band + band_slots) band_free.wait (&grid_mutex);
+
+  if (grid_abort || next_band >= band_count) return (NVFalse);
+
+
+  *band_num = next_band++;
+
+  GRID_BAND *bnd = &band[*band_num % band_slots];
+
+  bnd->start_row = *band_num * band_rows;
+  bnd->rows = qMin (band_rows, bag_height - bnd->start_row);
+
+
+  return (NVTrue);
+}
+
+
+
+//  Called by the gridding threads when a band has been gridded (or gridding failed).
+
+void 
+pfmBagEngine::bandDone (int32_t band_num, uint8_t ok)
+{
+  QMutexLocker lock (&grid_mutex);
+
+  if (ok)
+    {
+      band[band_num % band_slots].ready = NVTrue;
+    }
+  else
+    {
+      grid_abort = NVTrue;
+      band_free.wakeAll ();
+    }
+
+  band_ready.wakeAll ();
+}
+
+
+
+//  Write one row of the surface (and the optional datasets) to the BAG.
+
+uint8_t 
+pfmBagEngine::writeRow (int32_t row, float *elev_row, float *uncert_row, bagOptElevationSolutionGroup *optsol_row, bagOptNodeGroup *cube_row)
+{
+  bagError err;
+
+
+  if ((err = bagWriteRow (bag_handle, row, 0, bag_width - 1, Elevation, (void *) elev_row)) != BAG_SUCCESS)
+    return (bagFailure (tr ("Error writing elevation at row %1").arg (row), err));
+
+  if ((err = bagWriteRow (bag_handle, row, 0, bag_width - 1, Uncertainty, (void *) uncert_row)) != BAG_SUCCESS)
+    return (bagFailure (tr ("Error writing uncertainty at row %1").arg (row), err));
+
+  if ((err = bagWriteRow (bag_handle, row, 0, bag_width - 1, Elevation_Solution_Group, (void *) optsol_row)) != BAG_SUCCESS)
+    return (bagFailure (tr ("Error writing optional solution group node at row %1").arg (row), err));
+
+  if (options.surface == CUBE_SURFACE)
+    {
+      if ((err = bagWriteRow (bag_handle, row, 0, bag_width - 1, Node_Group, (void *) cube_row)) != BAG_SUCCESS)
+        return (bagFailure (tr ("Error writing CUBE node at row %1").arg (row), err));
+    }
+
+
+  return (NVTrue);
+}
+
+
+
+/*!
+    Compute a band of rows (start_row through start_row + rows - 1) of the BAG surface.  The band arrays are rows *
+    bag_width long.  This uses the scatter engine if it was selected, otherwise it grids the band a row at a time.
+*/
+
+uint8_t 
+pfmBagEngine::gridBand (GRID_CONTEXT *ctx, int32_t start_row, int32_t rows, float *elev, float *unc, bagOptElevationSolutionGroup *sol,
+                        bagOptNodeGroup *cub)
+{
+  if (file_hints) hintBand (start_row, rows);
+
+  if (scatter) return (scatterBand (ctx, start_row, rows, elev, unc, sol));
+
+
+  for (int32_t i = 0 ; i < rows ; i++)
+    {
+      int32_t offset = i * bag_width;
+
+      if (!gridRow (ctx, start_row + i, &elev[offset], &unc[offset], &sol[offset], cub ? &cub[offset] : NULL)) return (NVFalse);
+    }
+
+
+  return (NVTrue);
+}
+
+
+
+/*!
+    Compute one row of the BAG surface.  The row arrays are filled with elevation, uncertainty, optional elevation
+    solution group, and (for CUBE surfaces) optional node group values for each of the bag_width columns.  ctx holds
+    the PFM handle and projections to use (this may be running in one of the gridding threads).
+*/
+
+uint8_t 
+pfmBagEngine::gridRow (GRID_CONTEXT *ctx, int32_t row, float *elev_row, float *uncert_row, bagOptElevationSolutionGroup *optsol_row,
+                       bagOptNodeGroup *cube_row)
+{
+  int32_t lower = 0, upper = 0;
+  NV_F64_COORD2 xy[2] = {{0.0, 0.0}, {0.0, 0.0}};
+
+
+  if (system.coordSys == UTM)
+    {
+      if (!cellCorners (ctx, row, row + 1, &lower)) return (NVFalse);
+      if (!cellCorners (ctx, row + 1, row, &upper)) return (NVFalse);
+    }
+  else
+    {
+      xy[0].y = mbr.min_y + (double) row * y_bin_size_degrees;
+      xy[1].y = xy[0].y + y_bin_size_degrees;
+    }
+
+
+  if (ctx->prefetch) prefetchRows (ctx, row, row + options.prefetch);
+
+
+  int32_t span = mask_row ? mask_row[row] : 0;
+
+
+  //  Loop for the width of the PFM.
+
+  for (int32_t j = 0 ; j < bag_width ; j++)
+    {
+      NV_I32_COORD2 coord[2];
+
+
+      //  Determine the range of the cell coordinates of the cells that have data in the output bin.
+
+      if (system.coordSys == UTM)
+        {
+          //  Lower left corner of this cell and upper right corner (i.e. the upper left corner of the next cell).
+
+          xy[0].x = ctx->corner_x[lower][j];
+          xy[0].y = ctx->corner_y[lower][j];
+          xy[1].x = ctx->corner_x[upper][j + 1];
+          xy[1].y = ctx->corner_y[upper][j + 1];
+        }
+      else
+        {
+          xy[0].x = mbr.min_x + (double) j * x_bin_size_degrees;
+          xy[1].x = xy[0].x + x_bin_size_degrees;
+        }
+
+      compute_index_ptr (xy[0], &coord[0], &open_args.head);
+      compute_index_ptr (xy[1], &coord[1], &open_args.head);
+
+
+      if (options.surface == CUBE_SURFACE)
+        {
+          cube_row[j].hyp_strength = NULL_GENERIC;
+          cube_row[j].num_hypotheses = NULL_GENERIC;
+        }
+
+
+      CELL_STATS st;
+
+      clearCell (&st);
+
+
+      //  Cells outside of the area polygon are NULL, we don't need to read anything.
+
+      if (outsideArea (row, j, &span))
+        {
+          finishCell (&st, row, j, &elev_row[j], &uncert_row[j], &optsol_row[j]);
+          continue;
+        }
+
+
+      //  If we're running a CUBE surface we can't change the bin size or select the uncertainty type.  These will be hard-wired.
+
+      if (options.surface == CUBE_SURFACE)
+        {
+          BIN_RECORD bin;
+
+
+          //  Check for out of bounds (can happen when going to UTM).
+
+          if (coord[0].x >= 0 && coord[0].y >= 0 && coord[0].x < open_args.head.bin_width && coord[0].y < open_args.head.bin_height)
+            {
+              read_bin_record_index (ctx->pfm_handle, coord[0], &bin);
+
+              if (bin.validity & PFM_DATA)
+                {
+                  st.sum = bin.avg_filtered_depth;
+                  st.min_z = bin.min_filtered_depth;
+                  st.min_uncert = st.uncert_sum = bin.attr[fu_attr];
+                  cube_row[j].hyp_strength = bin.attr[hs_attr];
+                  cube_row[j].num_hypotheses = bin.attr[nh_attr];
+
+
+                  //  The elevation and uncertainty come from the bin record.  We only need the soundings to count the
+                  //  valid ones and to get the uncertainty of the minimum depth, which only matters for enhanced cells
+                  //  with a non-zero weight.  In CUBE fast mode we take the count from the bin record for the others.
+
+                  if (options.cube_fast && !(enhanced && weight_value (&weight, row, j)))
+                    {
+                      st.count = bin.num_soundings;
+                    }
+                  else
+                    {
+                      DEPTH_RECORD *depth;
+                      int32_t numrecs;
+
+                      if (!read_depth_array_index (ctx->pfm_handle, coord[0], &depth, &numrecs))
+                        {
+                          for (int32_t p = 0 ; p < numrecs ; p++)
+                            {
+                              if (!(depth[p].validity & (PFM_INVAL | PFM_DELETED | PFM_REFERENCE)))
+                                {
+                                  //  If we are creating the enhanced surface we need to get the uncertainty of the minimum depth.
+
+                                  if (enhanced && depth[p].xyz.z <= st.min_z) st.min_uncert = depth[p].vertical_error;
+
+
+                                  st.count++;
+                                }
+                            }
+
+                          free (depth);
+                        }
+                    }
+                }
+            }
+        }
+      else
+        {
+          //  Loop over the height and width of the covering cells.
+
+          for (int32_t m = coord[0].y ; m <= coord[1].y ; m++)
+            {
+              if (m >= 0 && m < open_args.head.bin_height)
+                {
+                  NV_I32_COORD2 icoord;
+                  icoord.y = m;
+
+                  for (int32_t n = coord[0].x ; n <= coord[1].x ; n++)
+                    {
+                      if (n >= 0 && n < open_args.head.bin_width)
+                        {
+                          icoord.x = n;
+
+
+                          //  The cache hands back the depth array already decoded into structure of arrays form
+                          //  (each array is decoded once however many BAG cells use it).  Let the (SIMD if we can)
+                          //  kernel filter the valid soundings in the cell and accumulate them.
+
+                          SOUNDING_BATCH *batch;
+
+                          if (!ctx->depth_cache->read (icoord, &batch))
+                            return (memoryError ("sounding batch", __LINE__, __FUNCTION__));
+
+                          if (batch) accumulate_soundings (batch, xy, &st);
+                        }
+                    }
+                }
+            }
+        }
+
+
+      finishCell (&st, row, j, &elev_row[j], &uncert_row[j], &optsol_row[j]);
+    }
+
+
+  return (NVTrue);
+}
+
+
+/*!
+    Compute a band of rows of the BAG surface with the scatter engine.  The gather engine (gridRow) reads every PFM
+    cell that covers each BAG cell so, when the BAG cells are smaller than (or not aligned with) the PFM cells, the
+    same depth array is read over and over.  Here we read the depth array of each PFM cell that covers the band once
+    and add each valid sounding to the statistics of the BAG cell that it falls in.  The statistics for the band are
+    kept in the context (band_rows * bag_width cells) so the memory used doesn't depend on the size of the BAG.  PFM
+    cells that straddle the edge between two bands are read once for each band.
+    <br><br>
+    There are two differences from the gather engine.  A sounding that falls exactly on the edge between two BAG cells
+    is only counted in one of them, and for UTM output the soundings are projected and binned in the UTM grid instead
+    of being checked against the lat/lon box of the cell corners.  This isn't used for CUBE surfaces, those come from
+    the PFM bin records.
+*/
+
+uint8_t 
+pfmBagEngine::scatterBand (GRID_CONTEXT *ctx, int32_t start_row, int32_t rows, float *elev, float *unc, bagOptElevationSolutionGroup *sol)
+{
+  NV_F64_COORD2 xy[2];
+  NV_I32_COORD2 coord[2];
+  int32_t margin = 0, first_col, last_col;
+
+
+  for (int32_t k = 0 ; k < rows * bag_width ; k++) clearCell (&ctx->stats[k]);
+
+
+  //  Only the columns that are inside the area polygon (if there is one) need to be covered.  If the band is entirely
+  //  outside of it we just write NULLs.
+
+  if (!areaColumns (start_row, rows, &first_col, &last_col))
+    {
+      for (int32_t i = 0 ; i < rows ; i++)
+        {
+          for (int32_t j = 0 ; j < bag_width ; j++)
+            {
+              int32_t k = i * bag_width + j;
+
+              finishCell (&ctx->stats[k], start_row + i, j, &elev[k], &unc[k], &sol[k]);
+            }
+        }
+
+      return (NVTrue);
+    }
+
+
+  //  Figure out which PFM cells cover the band.  For UTM output the edges of the band aren't lines of latitude or
+  //  longitude so we use the extents of the corners along the lower and upper boundaries of the band plus enough PFM
+  //  cells to cover how far the edges bow out between the corners.
+
+  if (system.coordSys == UTM)
+    {
+      int32_t lower = 0, upper = 0;
+
+      if (!cellCorners (ctx, start_row, start_row + rows, &lower)) return (NVFalse);
+      if (!cellCorners (ctx, start_row + rows, start_row, &upper)) return (NVFalse);
+
+      xy[0].x = xy[1].x = ctx->corner_x[lower][first_col];
+      xy[0].y = xy[1].y = ctx->corner_y[lower][first_col];
+
+      for (int32_t i = 0 ; i < 2 ; i++)
+        {
+          int32_t slot = i ? upper : lower;
+
+          for (int32_t j = first_col ; j <= last_col + 1 ; j++)
+            {
+              xy[0].x = qMin (xy[0].x, ctx->corner_x[slot][j]);
+              xy[0].y = qMin (xy[0].y, ctx->corner_y[slot][j]);
+              xy[1].x = qMax (xy[1].x, ctx->corner_x[slot][j]);
+              xy[1].y = qMax (xy[1].y, ctx->corner_y[slot][j]);
+            }
+        }
+
+
+      //  Measure the bow (the distance from the middle of the lat/lon chord to the transformed midpoint) of the two
+      //  sides of the band and of a cell wide piece of its lower and upper boundaries.  The margin is that many PFM
+      //  cells plus one.
+
+      int32_t mid = (first_col + last_col) / 2;
+      int32_t side[4][4] = {{first_col, start_row, first_col, start_row + rows},
+                            {last_col + 1, start_row, last_col + 1, start_row + rows},
+                            {mid, start_row, mid + 1, start_row},
+                            {mid, start_row + rows, mid + 1, start_row + rows}};
+      double bow_x = 0.0, bow_y = 0.0;
+
+      for (int32_t i = 0 ; i < 4 ; i++)
+        {
+          double px[3], py[3];
+
+          px[0] = proj_mbr.min_x + (double) side[i][0] * options.mbin_size;
+          py[0] = proj_mbr.min_y + (double) side[i][1] * options.mbin_size;
+          px[1] = proj_mbr.min_x + (double) side[i][2] * options.mbin_size;
+          py[1] = proj_mbr.min_y + (double) side[i][3] * options.mbin_size;
+          px[2] = (px[0] + px[1]) * 0.5;
+          py[2] = (py[0] + py[1]) * 0.5;
+
+          double in_x = px[2], in_y = py[2];
+
+          int32_t pj_status = pj_transform (ctx->bag_proj, ctx->pfm_proj, 3, 1, px, py, NULL);
+          if (pj_status || px[0] == HUGE_VAL || px[1] == HUGE_VAL || px[2] == HUGE_VAL)
+            return (transformError (pj_status ? pj_status : -14, __LINE__, __FUNCTION__, in_x, in_y, px[2] * NV_RAD_TO_DEG,
+                                    py[2] * NV_RAD_TO_DEG));
+
+          bow_x = qMax (bow_x, fabs (px[2] - (px[0] + px[1]) * 0.5) * NV_RAD_TO_DEG);
+          bow_y = qMax (bow_y, fabs (py[2] - (py[0] + py[1]) * 0.5) * NV_RAD_TO_DEG);
+        }
+
+      margin = 1 + qMax ((int32_t) ceil (bow_x / open_args.head.x_bin_size_degrees),
+                         (int32_t) ceil (bow_y / open_args.head.y_bin_size_degrees));
+    }
+  else
+    {
+      xy[0].x = mbr.min_x + (double) first_col * x_bin_size_degrees;
+      xy[0].y = mbr.min_y + (double) start_row * y_bin_size_degrees;
+      xy[1].x = mbr.min_x + (double) (last_col + 1) * x_bin_size_degrees;
+      xy[1].y = mbr.min_y + (double) (start_row + rows) * y_bin_size_degrees;
+    }
+
+  compute_index_ptr (xy[0], &coord[0], &open_args.head);
+  compute_index_ptr (xy[1], &coord[1], &open_args.head);
+
+  int32_t start_m = qMax (coord[0].y - margin, 0);
+  int32_t end_m = qMin (coord[1].y + margin, open_args.head.bin_height - 1);
+  int32_t start_n = qMax (coord[0].x - margin, 0);
+  int32_t end_n = qMin (coord[1].x + margin, open_args.head.bin_width - 1);
+
+
+  for (int32_t m = start_m ; m <= end_m ; m++)
+    {
+      NV_I32_COORD2 icoord;
+      icoord.y = m;
+
+      for (int32_t n = start_n ; n <= end_n ; n++)
+        {
+          DEPTH_RECORD *depth;
+          int32_t numrecs;
+
+          icoord.x = n;
+
+          if (read_depth_array_index (ctx->pfm_handle, icoord, &depth, &numrecs)) continue;
+
+
+          //  For UTM output we project all of the soundings in the PFM cell with one pj_transform call.  Soundings that
+          //  can't be transformed are flagged with HUGE_VAL and are skipped below.
+
+          if (system.coordSys == UTM && numrecs)
+            {
+              if (numrecs > ctx->sounding_size)
+                {
+                  //  Grow them through temporaries so a failed realloc doesn't lose the buffer (closeGridContext
+                  //  frees whatever we're holding).
+
+                  double *new_x = (double *) realloc (ctx->sounding_x, numrecs * sizeof (double));
+                  if (new_x) ctx->sounding_x = new_x;
+                  double *new_y = (double *) realloc (ctx->sounding_y, numrecs * sizeof (double));
+                  if (new_y) ctx->sounding_y = new_y;
+
+                  if (new_x == NULL || new_y == NULL)
+                    {
+                      free (depth);
+                      return (memoryError ("sounding", __LINE__, __FUNCTION__));
+                    }
+
+                  ctx->sounding_size = numrecs;
+                }
+
+              for (int32_t p = 0 ; p < numrecs ; p++)
+                {
+                  ctx->sounding_x[p] = depth[p].xyz.x * NV_DEG_TO_RAD;
+                  ctx->sounding_y[p] = depth[p].xyz.y * NV_DEG_TO_RAD;
+                }
+
+              int32_t pj_status = pj_transform (ctx->pfm_proj, ctx->bag_proj, numrecs, 1, ctx->sounding_x, ctx->sounding_y, NULL);
+
+              if (pj_status)
+                {
+                  double in_x = depth[0].xyz.x, in_y = depth[0].xyz.y;
+
+                  free (depth);
+                  return (transformError (pj_status, __LINE__, __FUNCTION__, in_x, in_y, ctx->sounding_x[0], ctx->sounding_y[0]));
+                }
+            }
+
+
+          for (int32_t p = 0 ; p < numrecs ; p++)
+            {
+              if (depth[p].validity & (PFM_INVAL | PFM_DELETED | PFM_REFERENCE)) continue;
+
+
+              //  Fractional BAG row and column of the sounding.
+
+              double r, c;
+
+              if (system.coordSys == UTM)
+                {
+                  if (ctx->sounding_x[p] == HUGE_VAL || ctx->sounding_y[p] == HUGE_VAL) continue;
+
+                  c = (ctx->sounding_x[p] - proj_mbr.min_x) / options.mbin_size;
+                  r = (ctx->sounding_y[p] - proj_mbr.min_y) / options.mbin_size - (double) start_row;
+                }
+              else
+                {
+                  c = (depth[p].xyz.x - mbr.min_x) / x_bin_size_degrees;
+                  r = (depth[p].xyz.y - mbr.min_y) / y_bin_size_degrees - (double) start_row;
+                }
+
+              if (r >= 0.0 && r < (double) rows && c >= 0.0 && c < (double) bag_width)
+                addSounding (&ctx->stats[(int32_t) r * bag_width + (int32_t) c], &depth[p]);
+            }
+
+          free (depth);
+        }
+    }
+
+
+  for (int32_t i = 0 ; i < rows ; i++)
+    {
+      //  Soundings from PFM cells that straddle the edge of the area polygon may have landed in cells outside of it.
+
+      maskRow (start_row + i, &ctx->stats[i * bag_width]);
+
+      for (int32_t j = 0 ; j < bag_width ; j++)
+        {
+          int32_t k = i * bag_width + j;
+
+          finishCell (&ctx->stats[k], start_row + i, j, &elev[k], &unc[k], &sol[k]);
+        }
+    }
+
+
+  return (NVTrue);
+}
+
+
+//  Initialize the running statistics of a cell.
+
+void 
+pfmBagEngine::clearCell (CELL_STATS *st)
+{
+  st->sum = 0.0;
+  st->sum2 = 0.0;
+  st->uncert_sum = 0.0;
+  st->uncert_sum2 = 0.0;
+  st->min_uncert = 9999999999.0;
+  st->count = 0;
+  st->max_z = -999999999.0;
+  st->min_z = 999999999.0;
+}
+
+
+
+//  Add a (valid) sounding to the running statistics of a cell.
+
+void 
+pfmBagEngine::addSounding (CELL_STATS *st, DEPTH_RECORD *depth)
+{
+  //  Get the minimum depth and the uncertainty of that depth.
+
+  if (depth->xyz.z <= st->min_z)
+    {
+      st->min_uncert = depth->vertical_error;
+      st->min_z = depth->xyz.z;
+    }
+
+  st->max_z = qMax (st->max_z, depth->xyz.z);
+
+  st->sum += depth->xyz.z;
+  st->sum2 += depth->xyz.z * depth->xyz.z;
+  st->uncert_sum += depth->vertical_error;
+  st->uncert_sum2 += depth->vertical_error * depth->vertical_error;
+  st->count++;
+}
+
+
+
+//  Compute the elevation, uncertainty, and optional elevation solution of BAG cell row, col from its statistics.
+
+void 
+pfmBagEngine::finishCell (CELL_STATS *st, int32_t row, int32_t col, float *elev, float *unc, bagOptElevationSolutionGroup *sol)
+{
+  *elev = NULL_ELEVATION;
+  *unc = NULL_UNCERTAINTY;
+
+  sol->stddev = NULL_STD_DEV;
+  sol->shoal_elevation = NULL_GENERIC;
+  sol->num_soundings = NULL_GENERIC;
+
+
+  if (st->count)
+    {
+      double avg = st->sum / (double) st->count;
+
+      switch (options.uncertainty)
+        {
+        case STD_UNCERT:
+          *unc = 0.0;
+
+          if (st->count > 1)
+            {
+              double variance = ((st->sum2 - ((double) st->count * (pow (avg, 2.0)))) / ((double) st->count - 1.0));
+              if (variance >= 0.0) *unc = sqrt (variance);
+            }
+          break;
+
+        case TPE_UNCERT:
+          if (enhanced)
+            {
+              float weight1 = (100.0 - (float) weight_value (&weight, row, col)) / 100.0;
+              float weight2 = (float) weight_value (&weight, row, col) / 100.0;
+              *unc = -((sqrt (st->uncert_sum2 / (double) st->count)) * weight1 + st->min_uncert * weight2);
+            }
+          else
+            {
+              *unc = sqrt (st->uncert_sum2 / (double) st->count);
+            }
+          break;
+
+        case FIN_UNCERT:
+          if (enhanced)
+            {
+              float weight1 = (100.0 - (float) weight_value (&weight, row, col)) / 100.0;
+              float weight2 = (float) weight_value (&weight, row, col) / 100.0;
+              *unc = -(st->uncert_sum * weight1 + st->min_uncert * weight2);
+            }
+          else
+            {
+              *unc = st->uncert_sum;
+            }
+          break;
+        }
+
+
+      switch (options.surface)
+        {
+        case MIN_SURFACE:
+          *elev = -st->min_z + options.elev_off;
+          break;
+
+        case MAX_SURFACE:
+          *elev = -st->max_z + options.elev_off;
+          break;
+
+        case AVG_SURFACE:
+          if (enhanced)
+            {
+              float weight1 = (100.0 - (float) weight_value (&weight, row, col)) / 100.0;
+              float weight2 = (float) weight_value (&weight, row, col) / 100.0;
+              *elev = -(avg * weight1 + st->min_z * weight2) + options.elev_off;
+            }
+          else
+            {
+              *elev = -avg + options.elev_off;
+            }
+          break;
+
+        case CUBE_SURFACE:
+          if (enhanced)
+            {
+              float weight1 = (100.0 - (float) weight_value (&weight, row, col)) / 100.0;
+              float weight2 = (float) weight_value (&weight, row, col) / 100.0;
+              *elev = -(st->sum * weight1 + st->min_z * weight2) + options.elev_off;
+            }
+          else
+            {
+              *elev = -st->sum + options.elev_off;
+            }
+          break;
+        }
+
+
+      sol->shoal_elevation = -st->min_z;
+      sol->num_soundings = st->count;
+
+      if (st->count > 1)
+        {
+          double variance = ((st->sum2 - ((double) st->count * (pow (avg, 2.0)))) / ((double) st->count - 1.0));
+          if (variance >= 0.0) sol->stddev = sqrt (variance);
+        }
+    }
+}
+
+
+
+//  Put the features in the tracking list.
+
+uint8_t 
+pfmBagEngine::writeTrackingList ()
+{
+  bagError err;
+  bagTrackingItem trackItem;
+  float value;
+
+
+  if (features)
+    {
+      callback->progressRange (TRACKING_PROGRESS, 0, eligible_count);
+
+      for (int32_t i = 0 ; i < eligible_count ; i++)
+        {
+          callback->progressValue (TRACKING_PROGRESS, i);
+
+          ELIGIBLE_FEATURE *ef = &eligible[i];
+
+          if (system.coordSys == UTM)
+            {
+              trackItem.row = NINT (((ef->proj_pos.y - proj_mbr.min_y) / options.mbin_size) + 0.5) ;
+              trackItem.col = NINT (((ef->proj_pos.x - proj_mbr.min_x) / options.mbin_size) + 0.5) ;
+            }
+          else
+            {
+              trackItem.row = NINT (((ef->proj_pos.y - mbr.min_y) / y_bin_size_degrees) + 0.5) ;
+              trackItem.col = NINT (((ef->proj_pos.x - mbr.min_x) / x_bin_size_degrees) + 0.5) ;
+            }
+
+          if ((err = bagReadNode (bag_handle, trackItem.row, trackItem.col, Elevation, (void *) &value)) != BAG_SUCCESS)
+            return (bagFailure (tr ("Error reading elevation node at %1, %2").arg (trackItem.row).arg (trackItem.col), err));
+
+
+          trackItem.depth = -value;
+
+
+          //  OK.  Let's talk about BAG.  The track_code is just a number that's supposed to tell you what the tracking list item is
+          //  all about.  Apparently BAG wants to use bagDesignatedSndg to denote a selected IHO feature (in NAVO's version of GSF
+          //  processing, this would be NV_GSF_SELECTED_DESIGNATED).  In PFM we use PFM_SELECTED_FEATURE for these.  We use
+          //  PFM_DESIGNATED_SOUNDING to indicate a selected sounding that needs to be saved into the tracking list but *isn't* an
+          //  IHO selected feature.  In BFD we have parent and child features.  Parent features are always IHO features
+          //  (PFM_SELECTED_FEATURE).  Child features will be PFM_DESIGNATED_SOUNDINGS.  As far as I can tell there is no track_code
+          //  value for this kind of point in either BAG 1.5.3 or the (yet to be implemented here) BAG 1.6.0.  The only available
+          //  values are, in enum order: bagManualEdit, bagDesignatedSndg, bagRecubedSurfaces, and bagDeleteNode.  Obviosly, none of
+          //  these will work for our children (or our children's, children's, children [Moody Blues reference] for that matter).
+          //  So, I'm going to set the track_code to 129 to indicate a child (in BFD), a PFM_DESIGNATED_SOUNDING (in PFM), a
+          //  NV_GSF_SELECTED_SPARE_1 (in GSF), and a CZMIL_RETURN_DESIGNATED_SOUNDING (in CZMIL CPF).  If the BFDATA_RECORD
+          //  "parent_record" field is set to anything other than zero, then it is a child record of the (parent_record - 1) feature.
+
+          if (ef->parent)
+            {
+              trackItem.track_code = 129;
+            }
+          else
+            {
+              trackItem.track_code = bagDesignatedSndg;
+            }
+
+
+          //  Now, list_series.  According to the BAG documentation (HA!  I had to look at the code), the list_series is the
+          //  "index number indicating the item in the metadata that describes the modifications".  What the hell does that
+          //  mean?  What item?  What modifications?  Oh, I get it now.  It was intuitively obvious to the most casual
+          //  observer.  What they mean is that this points to the bag_metadata.dataQualityInfo->lineageProcessSteps entry
+          //  that has information about this tracking list item, why it's here, and what modifications were made.  In other
+          //  words, bag_metadata.dataQualityInfo->lineageProcessSteps[trackItem.list_series].  Boy do I feel dumb now!
+          //  It was so simple, like the jitterbug it plumb evaded me [Jimmy Buffett reference].
+
+          trackItem.list_series = i;
+
+
+          //  Write the tracking list item.
+
+          if ((err = bagWriteTrackingListItem (bag_handle, &trackItem)) != BAG_SUCCESS)
+            return (bagFailure (tr ("Error adding tracking list item"), err));
+
+
+          //  Write the modified nodes.
+
+          value = -ef->depth;
+          if ((err = bagWriteNode (bag_handle, trackItem.row, trackItem.col, Elevation, (void *) &value)) != BAG_SUCCESS)
+            return (bagFailure (tr ("Error writing elevation node at %1,%2").arg (trackItem.row).arg (trackItem.col), err));
+        }
+
+      callback->progressValue (TRACKING_PROGRESS, eligible_count);
+
+
+      //  Close the bfd file here.  This frees the short feature structure.
+
+      binaryFeatureData_close_file (bfd_handle);
+      bfd_handle = -1;
+      feature = NULL;
+
+      free (eligible);
+      eligible = NULL;
+      free (eligible_index);
+      eligible_index = NULL;
+      eligible_count = 0;
+    }
+
+
+  return (NVTrue);
+}
+
+
+
+//  Update the surfaces and, if we added any features to the tracking list, redo the XML metadata.
+
+uint8_t 
+pfmBagEngine::updateSurfaces ()
+{
+  bagError err;
+
+
+  if ((err = bagUpdateSurface (bag_handle, Elevation)) != BAG_SUCCESS)
+    return (bagFailure (tr ("Error updating elevation surface"), err));
+
+
+  if ((err = bagUpdateSurface (bag_handle, Uncertainty)) != BAG_SUCCESS)
+    return (bagFailure (tr ("Error updating uncertainty surface"), err));
+
+
+  if ((err = bagUpdateSurface (bag_handle, Elevation_Solution_Group)) != BAG_SUCCESS)
+    return (bagFailure (tr ("Error updating optional elevation solution group surface"), err));
+
+  bagFreeArray (bag_handle, Elevation_Solution_Group);
+
+
+  if (options.surface == CUBE_SURFACE)
+    {
+      if ((err = bagUpdateSurface (bag_handle, Node_Group)) != BAG_SUCCESS)
+        return (bagFailure (tr ("Error updating CUBE node surface"), err));
+
+      bagFreeArray (bag_handle, Node_Group);
+    }
+
+
+  //  If we added any features to the tracking list we need to redo the XML metadata.
+
+  if (bag_metadata.dataQualityInfo->numberOfProcessSteps)
+    {
+      bagGetDataPointer (bag_handle)->metadata = xmlBuffer;
+
+
+      if ((err = bagWriteXMLStream (bag_handle)) != BAG_SUCCESS)
+        return (bagFailure (tr ("Error writing XML stream"), err));
+    }
+
+
+  return (NVTrue);
+}
+
+
+
+//  Adding optional separation surface if requested.
+
+uint8_t 
+pfmBagEngine::writeSeparation ()
+{
+  bagError err;
+  bagData opt_data_sep;
+  int32_t sep_handle = -1, pj_status = 0;
+  FILE *sep_fp = NULL;
+  char sep_file[512], sep_string[128];
+  CHRTR2_HEADER sep_header;
+  CHRTR2_RECORD sep_record;
+
+
+  if (!options.sep_file_name.isEmpty ())
+    {
+      bagVerticalCorrectorDef bvc;
+
+      memset (&opt_data_sep, 0, sizeof(opt_data_sep));
+
+      strcpy (sep_file, options.sep_file_name.toLatin1 ());
+
+
+      //  Copy most of the default setup for the main BAG.
+
+      opt_data_sep.def = data.def;
+
+
+      //  Check for .ch2 extension.
+
+      if (options.sep_file_name.endsWith (".ch2"))
+        {
+          if ((sep_handle = chrtr2_open_file (sep_file, &sep_header, CHRTR2_READONLY)) < 0)
+            {
+              callback->errorMessage (tr ("Unable to open CHRTR2 separation file %1\nReason: %2").arg (options.sep_file_name).arg (QString (chrtr2_strerror ())));
+              return (NVFalse);
+            }
+
+          opt_data_sep.opt[Surface_Correction].ncols = sep_header.width;
+          opt_data_sep.opt[Surface_Correction].nrows = sep_header.height;
+          bvc.nodeSpacingX = sep_header.lon_grid_size_degrees;
+          bvc.nodeSpacingY = sep_header.lat_grid_size_degrees;
+          bvc.swCornerX = sep_header.mbr.wlon;
+          bvc.swCornerY = sep_header.mbr.slat;
+        }
+      else
+        {
+          if ((sep_fp = fopen (sep_file, "r")) == NULL)
+            {
+              callback->errorMessage (tr ("Unable to open ASCII separation file %1\nReason: %2").arg (options.sep_file_name).arg (QString (strerror (errno))));
+              return (NVFalse);
+            }
+
+
+          ngets (sep_string, sizeof (sep_string), sep_fp);
+
+          if (!strstr (sep_string, "LAT,LONG,Z0,Z1"))
+            {
+              fclose (sep_fp);
+              callback->errorMessage (tr ("ASCII separation file %1 format incorrect").arg (options.sep_file_name));
+              return (NVFalse);
+            }
+
+
+          //  Unfortunately, for ASCII files we have to read the whole file to determine the width, height, and other stuff.
+
+          int32_t pos = ftell (sep_fp);
+          int32_t y_count = 0, x_count = 0;
+          double x, y, z0, z1, prev_x = 999.0, prev_y = 999.0;
+          uint8_t first_x = NVTrue;
+
+          while (ngets (sep_string, sizeof (sep_string), sep_fp) != NULL)
+            {
+              sscanf (sep_string, "%lf,%lf,%lf,%lf", &y, &x, &z0, &z1);
+
+              if (first_x)
+                {
+                  bvc.swCornerX = x;
+                  first_x = NVFalse;
+                }
+
+              if (prev_y != y)
+                {
+                  y_count++;
+                  bvc.nodeSpacingY = prev_y - y;
+                }
+
+              if (prev_x != x) x_count++;
+
+              prev_y = y;
+              prev_x = x;
+            }
+
+          fseek (sep_fp, pos, SEEK_SET);
+
+          x_count /= y_count;
+
+          opt_data_sep.opt[Surface_Correction].ncols = x_count;
+          opt_data_sep.opt[Surface_Correction].nrows = y_count;
+          bvc.nodeSpacingX = x - prev_x;
+          bvc.swCornerY = y;
+        }
+
+      err = bagWriteCorrectorDefinition (bag_handle, &bvc);      
+      if (err != BAG_SUCCESS) return (bagFailure (tr ("Could not write corrector definition"), err));
+
+
+      err = bagCreateCorrectorDataset (bag_handle, &opt_data_sep, 2, BAG_SURFACE_GRID_EXTENTS);      
+      if (err != BAG_SUCCESS) return (bagFailure (tr ("Error creating corrector dataset"), err));
+
+      bagVerticalCorrector *sep_depth = (bagVerticalCorrector *) calloc (opt_data_sep.def.ncols, sizeof (bagVerticalCorrector));
+      if (sep_depth == NULL)
+        {
+          callback->errorMessage (tr ("Error allocating sep_depth : %1").arg (strerror (errno)));
+          return (NVFalse);
+        }
+
+      for (uint32_t i = 0 ; i < opt_data_sep.def.nrows ; i++)
+        {
+          NV_I32_COORD2 coord;
+
+          coord.y = i;
+
+          for (uint32_t j = 0 ; j < opt_data_sep.def.ncols ; j++)
+            {
+              coord.x = j;
+
+              if (sep_fp)
+                {
+                  ngets (sep_string, sizeof (sep_string), sep_fp);
+
+                  sscanf (sep_string, "%lf,%lf,%f,%f", &sep_depth[j].y, &sep_depth[j].x, &sep_depth[j].z[0], &sep_depth[j].z[1]);
+                }
+              else
+                {
+                  chrtr2_read_record (sep_handle, coord, &sep_record);
+
+                  chrtr2_get_lat_lon (sep_handle, &sep_depth[j].y, &sep_depth[j].x, coord);
+
+
+                  //  SABER uses the opposite terminology for Z0 and Z1 from what CHRTR2 uses so we'll flip Z0 and Z1.
+
+                  sep_depth[j].z[0] = sep_record.z1;
+                  sep_depth[j].z[1] = sep_record.z0;
+                }
+
+
+                //  If we're making a UTM projected BAG, convert positions to UTM.
+
+              if (system.coordSys == UTM)
+                {
+                  double x = sep_depth[j].x * NV_DEG_TO_RAD;
+                  double y = sep_depth[j].y * NV_DEG_TO_RAD;
+                  pj_status = pj_transform (pfm_proj, bag_proj, 1, 1, &x, &y, NULL);
+                  if (pj_status)
+                    {
+                      transformError (pj_status, __LINE__, __FUNCTION__, sep_depth[j].x, sep_depth[j].y, x, y);
+                      free (sep_depth);
+                      return (NVFalse);
+                    }
+                  sep_depth[j].x = x;
+                  sep_depth[j].y = y;
+                }
+            }
+
+          err = bagWriteRow (bag_handle, i, 0, opt_data_sep.def.ncols - 1, Surface_Correction, (void *) sep_depth);
+        }
+
+      if (sep_fp)
+        {
+          fclose (sep_fp);
+        }
+      else
+        {
+          chrtr2_close_file (sep_handle);
+        }
+
+      free (sep_depth);
+
+      bagWriteCorrectorVerticalDatum (bag_handle, 1, (u8 *) "Mean lower low water = Vertical Datum");
+    }
+
+
+  return (NVTrue);
+}
+
+
+
+//  Close the BAG file and free the metadata.
+
+uint8_t 
+pfmBagEngine::closeBag ()
+{
+  bagError err;
+
+
+  //  IMPORTANT NOTE: bagFileClose will free the xmlBuffer.
+
+  if ((err = bagFileClose (bag_handle)) != BAG_SUCCESS) return (bagFailure (tr ("Error closing BAG file"), err));
+
+  xmlBuffer = NULL;
+
+
+  //  Free the metadata
+
+  bagFreeMetadata (&bag_metadata); 
+
+
+  close_pfm_file (pfm_handle);
+  pfm_handle = -1;
+
+  delete handle_pool;
+  handle_pool = NULL;
+
+
+  return (NVTrue);
+}
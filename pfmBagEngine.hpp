@@ -0,0 +1,431 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#ifndef PFMBAGENGINE_H
+#define PFMBAGENGINE_H
+
+#include <QtCore>
+#include <stdtypes.h>
+#include <proj_api.h>
+
+#include "nvutility.h"
+
+#include "pfm.h"
+#include "hyp.h"
+#include "hdf5.h"
+
+#include <gdal.h>
+#include <gdal_priv.h>
+#include <cpl_string.h>
+#include <ogr_spatialref.h>
+
+#include "bag.h"
+#include "bag_legacy.h"
+
+#include "binaryFeatureData.h"
+
+#include "chrtr2.h"
+#include "shapefil.h"
+
+#include "pfmBagDepthCache.hpp"
+#include "pfmBagFileHints.hpp"
+#include "pfmBagGeoDistance.hpp"
+#include "pfmBagHandlePool.hpp"
+#include "pfmBagPrefetchThread.hpp"
+#include "pfmBagRemarks.hpp"
+#include "pfmBagSoundings.hpp"
+#include "pfmBagWeightGrid.hpp"
+
+
+#define MIN_SURFACE  0
+#define MAX_SURFACE  1
+#define AVG_SURFACE  2
+#define CUBE_SURFACE 3
+
+#define STD_UNCERT   0
+#define TPE_UNCERT   1
+#define FIN_UNCERT   2
+
+#define GATHER_WEIGHTS  0
+#define SPLAT_WEIGHTS   1
+
+#define GATHER_GRID     0
+#define SCATTER_GRID    1
+
+
+//  Progress stages reported through pfmBagCallback::progressRange and pfmBagCallback::progressValue.
+
+#define WEIGHT_PROGRESS    0
+#define SURFACE_PROGRESS   1
+#define TRACKING_PROGRESS  2
+
+
+//  Maximum number of gridding threads.  Each one has its own PFM handle so don't get carried away.
+
+#define MAX_GRID_THREADS   32
+
+
+//  Number of rows in a band of rows handed to a weight thread.
+
+#define WEIGHT_BAND_ROWS   64
+
+
+/*!
+    Everything that a weight thread needs of its own.  For geographic BAGs that's a PFM handle for pfm_geo_distance
+    (leased from the handle pool if leased is set, otherwise it's the engine's) and a row of tangent plane distances
+    (bag_width long) for the splat engine.  For UTM BAGs pfm_handle is -1 and row_dist is NULL.
+*/
+
+typedef struct
+{
+  int32_t                      pfm_handle;
+  uint8_t                      leased;
+  double                       *row_dist;
+} WEIGHT_CONTEXT;
+
+
+//  Maximum number of rows in a band of rows handed to a gridding thread and the maximum amount of memory (in bytes)
+//  that we'll use for bands that have been (or are being) gridded but haven't been written to the BAG yet.
+
+#define GRID_BAND_ROWS     16
+#define GRID_BAND_MEMORY   268435456
+
+
+//  Size (in BAG cells) of the square buckets used to index the features for the enhanced surface weight computation.
+//  It has to divide WEIGHT_TILE_CELLS so that every cell of a feature's buckets is in one of its weight grid tiles.
+
+#define FEATURE_BUCKET_CELLS  16
+
+
+/*!
+    Everything the conversion engine needs to know to build a BAG.  This is the conversion part of the OPTIONS
+    structure (plus the file names that the wizard keeps in the pages) without any of the GUI stuff so that the
+    engine can be run without a QApplication (and without an X server).
+*/
+
+typedef struct
+{
+  QString       pfm_file_name;
+  QString       output_file_name;
+  QString       area_file_name;        //  Empty if no area file
+  QString       sep_file_name;         //  Empty if no separation file
+  int32_t       surface;
+  double        mbin_size;
+  double        gbin_size;
+  int32_t       uncertainty;
+  uint8_t       enhanced;
+  int32_t       depth_cor;             //  0 - corrected, 1 - 1550 m/s, 2 - 4800 ft/s, 3 - 800 fm/s, 4 - mixed
+  int32_t       v_datum;
+  QString       v_datum_name;          //  options->v_datums[options->v_datum].name
+  QString       pfm_wkt;
+  QString       bag_wkt;
+  float         elev_off;              //  Offset (in "units") to be ADDED to each BAG Elevation
+  float         non_radius;            //  Radius to be used for non-pfmFeature features when making the enhanced surface.
+  QString       source;
+  int32_t       classification;        //  0 - Unclassified, 1 - Confidential, 2 - Secret, 3 - Top Secret
+  int32_t       authority;
+  QDate         declassDate;
+  QString       distStatement;
+  QString       title;
+  QString       pi_name;
+  QString       pi_title;
+  QString       poc_name;
+  QString       abstract;
+  int32_t       threads;               //  Number of gridding threads (0 - use the number of processors)
+  int32_t       weight_engine;         //  GATHER_WEIGHTS or SPLAT_WEIGHTS
+  double        approx_error;          //  Maximum error (meters) for approximate UTM cell corner transforms (0.0 - exact)
+  int32_t       grid_engine;           //  GATHER_GRID or SCATTER_GRID
+  int32_t       depth_cache;           //  Size (MB) of each gridding thread's depth array cache (0 - no cache)
+  int32_t       prefetch;              //  Number of BAG rows to read ahead of each gridding thread (0 - no read ahead)
+  uint8_t       cube_fast;             //  CUBE surface counts from the bin records (soundings only for weighted cells)
+  uint8_t       file_hints;            //  Tell the kernel which parts of the PFM bin and depth files we'll be reading
+  char          progname[256];
+} CONVERT_OPTIONS;
+
+
+
+/*!
+    Everything that a gridding thread needs of its own.  libpfm handles and proj4 projections can't be shared
+    between threads so each gridding thread leases a PFM handle from the engine's handle pool and initializes the
+    projections itself (unless shared is set, in which case it's using the engine's PFM handle and projections).  For UTM output the context also
+    keeps the last two rows of cell corners (transformed to lat/lon, in degrees) so that each row of corners only
+    has to be transformed once.  corner_row is the row boundary (0 through bag_height) that is stored in each
+    corner array (-1 if none).  The scatter gridding engine keeps the statistics of a band of cells (band_rows *
+    bag_width) and, for UTM output, the projected positions of the soundings of the PFM cell it is working on.  The
+    gather engine reads the depth arrays (for everything but CUBE surfaces) through the context's depth_cache and,
+    if read ahead is on, the context's prefetch thread (which has its own leased PFM handle, prefetch_handle).  Both
+    keep the arrays decoded for the SIMD filter and accumulate kernel.  prefetch_range holds the PFM column ranges
+    (prefetch_range_size pairs) that cover the inside of the area polygon in the rows we're reading ahead.
+*/
+
+typedef struct
+{
+  uint8_t                      shared;
+  int32_t                      pfm_handle;
+  projPJ                       pfm_proj;
+  projPJ                       bag_proj;
+  int32_t                      corner_row[2];
+  double                       *corner_x[2];
+  double                       *corner_y[2];
+  double                       approx_error;          //  Largest estimated error (meters) of the approximate transforms
+  CELL_STATS                   *stats;
+  double                       *sounding_x;
+  double                       *sounding_y;
+  int32_t                      sounding_size;
+  pfmBagDepthCache             *depth_cache;
+  pfmBagPrefetchThread         *prefetch;
+  int32_t                      prefetch_handle;
+  int32_t                      *prefetch_range;
+  int32_t                      prefetch_range_size;
+} GRID_CONTEXT;
+
+
+
+/*!
+    A band of consecutive BAG rows.  The gridding threads fill in the row arrays (each one is rows * bag_width
+    long) and the engine writes them to the BAG in row order.
+*/
+
+typedef struct
+{
+  int32_t                      start_row;
+  int32_t                      rows;
+  uint8_t                      ready;
+  float                        *elevation;
+  float                        *uncert;
+  bagOptElevationSolutionGroup *optsol;
+  bagOptNodeGroup              *cube;
+} GRID_BAND;
+
+
+
+/*!
+    A feature that is used in the BAG (Hydrographic, confidence above 2, and inside the BAG bounds).  pos is lon/lat,
+    proj_pos is in the BAG CRS, radius is the enhanced surface search radius (0 if not enhanced), parent is the
+    feature's parent_record, and index is its record number in the feature file.
+*/
+
+typedef struct
+{
+  NV_F64_COORD2                pos;
+  NV_F64_COORD2                proj_pos;
+  float                        depth;
+  double                       radius;
+  uint32_t                     parent;
+  uint32_t                     index;
+} ELIGIBLE_FEATURE;
+
+
+
+/*!
+    Interface used by pfmBagEngine to report progress, status messages, and errors.  The wizard implements this
+    with progress bars, the process status list, and message boxes.  Anything else (e.g. a command line driver)
+    can implement it however it likes.  An error is always fatal, pfmBagEngine::run will return NVFalse right
+    after it calls errorMessage.
+*/
+
+class pfmBagCallback
+{
+public:
+
+  virtual ~pfmBagCallback () {};
+
+  virtual void progressRange (int32_t stage, int32_t min, int32_t max) = 0;
+  virtual void progressValue (int32_t stage, int32_t value) = 0;
+  virtual void statusMessage (QString msg) = 0;
+  virtual void warningMessage (QString msg) = 0;
+  virtual void errorMessage (QString msg) = 0;
+};
+
+
+
+/*!
+    The PFM to BAG conversion engine.  This used to live in pfmBag::slotCustomButtonClicked.  It doesn't use any
+    GUI classes so it can be run from the wizard or from the command line.
+*/
+
+class pfmBagEngine
+{
+  Q_DECLARE_TR_FUNCTIONS (pfmBagEngine)
+
+  friend class pfmBagGridThread;
+  friend class pfmBagWeightThread;
+
+
+public:
+
+  pfmBagEngine (CONVERT_OPTIONS *op, pfmBagCallback *cb);
+  ~pfmBagEngine ();
+
+  uint8_t run ();
+
+
+protected:
+
+  uint8_t openFiles ();
+  uint8_t defineMetadata ();
+  uint8_t readArea ();
+  uint8_t defineArea ();
+  uint8_t defineCRS ();
+  uint8_t defineGrid ();
+  uint8_t buildAreaMask ();
+  uint8_t outsideArea (int32_t row, int32_t col, int32_t *span);
+  uint8_t areaColumns (int32_t start_row, int32_t rows, int32_t *first_col, int32_t *last_col);
+  void maskRow (int32_t row, CELL_STATS *st);
+  uint8_t selectFeatures ();
+  uint8_t computeWeights ();
+  uint8_t gatherWeights ();
+  void gatherBand (WEIGHT_CONTEXT *ctx, int32_t start_row, int32_t rows);
+  uint8_t splatWeights ();
+  void splatBand (WEIGHT_CONTEXT *ctx, int32_t start_row, int32_t rows);
+  uint8_t weightBands ();
+  uint8_t nextWeightBand (int32_t *start_row, int32_t *rows);
+  void weightBandDone ();
+  void weightBand (WEIGHT_CONTEXT *ctx, int32_t start_row, int32_t rows);
+  uint8_t buildFeatureIndex ();
+  void featureCells (ELIGIBLE_FEATURE *ef, int32_t *cells);
+  uint8_t defineLineage ();
+  uint8_t createBag ();
+  uint8_t writeSurface ();
+  uint8_t gridBands (int32_t num_threads);
+  uint8_t openGridContext (GRID_CONTEXT *ctx, uint8_t shared);
+  void closeGridContext (GRID_CONTEXT *ctx);
+  void prefetchRows (GRID_CONTEXT *ctx, int32_t start_row, int32_t end_row);
+  void hintBand (int32_t start_row, int32_t rows);
+  uint8_t nextBand (int32_t *band_num);
+  void bandDone (int32_t band_num, uint8_t ok);
+  uint8_t cellCorners (GRID_CONTEXT *ctx, int32_t boundary, int32_t keep, int32_t *slot);
+  uint8_t approxCorners (GRID_CONTEXT *ctx, double *x, double *y, double py, int32_t start, int32_t end);
+  uint8_t gridBand (GRID_CONTEXT *ctx, int32_t start_row, int32_t rows, float *elev, float *unc, bagOptElevationSolutionGroup *sol,
+                    bagOptNodeGroup *cub);
+  uint8_t gridRow (GRID_CONTEXT *ctx, int32_t row, float *elev_row, float *uncert_row, bagOptElevationSolutionGroup *optsol_row,
+                   bagOptNodeGroup *cube_row);
+  uint8_t scatterBand (GRID_CONTEXT *ctx, int32_t start_row, int32_t rows, float *elev, float *unc, bagOptElevationSolutionGroup *sol);
+  void clearCell (CELL_STATS *st);
+  void addSounding (CELL_STATS *st, DEPTH_RECORD *depth);
+  void finishCell (CELL_STATS *st, int32_t row, int32_t col, float *elev, float *unc, bagOptElevationSolutionGroup *sol);
+  uint8_t writeRow (int32_t row, float *elev_row, float *uncert_row, bagOptElevationSolutionGroup *optsol_row, bagOptNodeGroup *cube_row);
+  uint8_t writeTrackingList ();
+  uint8_t updateSurfaces ();
+  uint8_t writeSeparation ();
+  uint8_t closeBag ();
+
+  uint8_t transformError (int32_t status, int32_t line, const char *function, double in_x, double in_y, double out_x, double out_y);
+  uint8_t bagFailure (QString string, bagError err);
+  uint8_t memoryError (const char *what, int32_t line, const char *function);
+  int32_t leaseHandle (QString what);
+
+
+  CONVERT_OPTIONS              options;
+
+  pfmBagCallback               *callback;
+
+  PFM_OPEN_ARGS                open_args;
+
+  int32_t                      pfm_handle, bfd_handle, bag_width, bag_height, fu_attr, hs_attr, nh_attr;
+
+  BFDATA_HEADER                bfd_header;
+
+  BFDATA_SHORT_FEATURE         *feature;
+
+  ELIGIBLE_FEATURE             *eligible;
+
+  int32_t                      eligible_count, *eligible_index;
+
+  uint8_t                      features, enhanced;
+
+  projPJ                       pfm_proj, bag_proj;
+
+  char                         pfm_proj4[256], bag_proj4[256];
+
+  uint8_t                      io_crs_equal;
+
+  bagLegacyReferenceSystem     system;
+
+  NV_F64_XYMBR                 mbr, proj_mbr;
+
+  double                       x_bin_size_degrees, y_bin_size_degrees, half_x, half_y, log_array[100];
+
+  BAG_METADATA                 bag_metadata;
+
+  bagHandle                    bag_handle;
+
+  bagData                      data;
+
+  uint8_t                      *xmlBuffer;
+
+  WEIGHT_GRID                  weight;
+
+  int32_t                      *bucket_start, *bucket_feature, bucket_width, bucket_height;
+
+  GEO_ROW                      *geo_rows;
+
+  int32_t                      *feature_cells, weight_band_count, next_weight_band, weight_bands_done;
+
+  float                        *elevation, *uncert;
+
+  bagOptElevationSolutionGroup *optsol;
+
+  bagOptNodeGroup              *cube;
+
+  GRID_BAND                    *band;
+
+  int32_t                      band_rows, band_count, band_slots, next_band, write_band;
+
+  uint8_t                      grid_abort, error_reported, scatter;
+
+  double                       approx_error;
+
+  int64_t                      cache_hits, cache_misses, prefetched;
+
+  pfmBagFileHints              *file_hints;
+
+  pfmBagHandlePool             *handle_pool;
+
+  int32_t                      hint_row[2];
+
+  double                       *area_x, *area_y;
+
+  int32_t                      area_count, area_parts, *area_part, *mask_row, *mask_span;
+
+  QMutex                       grid_mutex, error_mutex;
+
+  QWaitCondition               band_ready, band_free;
+};
+
+#endif
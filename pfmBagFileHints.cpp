@@ -0,0 +1,144 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include "pfmBagFileHints.hpp"
+
+#ifndef NVWIN3X
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+
+pfmBagFileHints::pfmBagFileHints ()
+{
+  bin_fd = ndx_fd = -1;
+  bin_rows = 0;
+  bin_size = ndx_size = 0;
+  ndx_loaded = NVFalse;
+}
+
+
+
+pfmBagFileHints::~pfmBagFileHints ()
+{
+#ifndef NVWIN3X
+  if (bin_fd >= 0) close (bin_fd);
+  if (ndx_fd >= 0) close (ndx_fd);
+#endif
+}
+
+
+
+/*!
+    Find the bin (.bin) and depth (.ndx) files in the PFM list file, open them, and ask for the whole depth file if
+    it's less than a quarter of physical memory.  rows is the PFM height in bins.  Returns NVFalse if neither file
+    could be opened (or this isn't a POSIX system).
+*/
+
+uint8_t 
+pfmBagFileHints::open (const char *list_path, int32_t rows)
+{
+#ifdef NVWIN3X
+  Q_UNUSED (list_path);
+  Q_UNUSED (rows);
+
+  return (NVFalse);
+#else
+  QFile list (QString (list_path));
+
+  if (!list.open (QIODevice::ReadOnly | QIODevice::Text)) return (NVFalse);
+
+  while (!list.atEnd () && (bin_path.isEmpty () || ndx_path.isEmpty ()))
+    {
+      QString line = QString (list.readLine ()).trimmed ();
+
+      if (bin_path.isEmpty () && line.endsWith (".bin", Qt::CaseInsensitive)) bin_path = line;
+      if (ndx_path.isEmpty () && line.endsWith (".ndx", Qt::CaseInsensitive)) ndx_path = line;
+    }
+
+  list.close ();
+
+
+  struct stat st;
+
+  if (!bin_path.isEmpty () && (bin_fd = ::open (bin_path.toLocal8Bit ().constData (), O_RDONLY)) >= 0)
+    {
+      if (!fstat (bin_fd, &st)) bin_size = st.st_size;
+      bin_rows = qMax (rows, 1);
+    }
+
+  if (!ndx_path.isEmpty () && (ndx_fd = ::open (ndx_path.toLocal8Bit ().constData (), O_RDONLY)) >= 0)
+    {
+      if (!fstat (ndx_fd, &st)) ndx_size = st.st_size;
+
+      int64_t memory = (int64_t) sysconf (_SC_PHYS_PAGES) * (int64_t) sysconf (_SC_PAGE_SIZE);
+
+      if (ndx_size > 0 && memory > 0 && ndx_size < memory / 4)
+        ndx_loaded = !posix_fadvise (ndx_fd, 0, 0, POSIX_FADV_WILLNEED);
+    }
+
+  return (bin_fd >= 0 || ndx_fd >= 0);
+#endif
+}
+
+
+
+/*!
+    Ask for the part of the bin file that holds PFM rows first_row through last_row.  The header size isn't known
+    here so the offsets are a proportion of the file size and we add a row on either side to cover for it.
+*/
+
+void 
+pfmBagFileHints::willNeed (int32_t first_row, int32_t last_row)
+{
+#ifdef NVWIN3X
+  Q_UNUSED (first_row);
+  Q_UNUSED (last_row);
+#else
+  if (bin_fd < 0 || bin_size <= 0) return;
+
+  first_row = qMax (first_row - 1, 0);
+  last_row = qMin (last_row + 2, bin_rows);
+
+  if (last_row <= first_row) return;
+
+  int64_t start = bin_size * first_row / bin_rows;
+  int64_t end = bin_size * last_row / bin_rows;
+
+  posix_fadvise (bin_fd, (off_t) start, (off_t) (end - start), POSIX_FADV_WILLNEED);
+#endif
+}
@@ -0,0 +1,79 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#ifndef PFMBAGFILEHINTS_H
+#define PFMBAGFILEHINTS_H
+
+#include <QtCore>
+#include <stdtypes.h>
+
+#include "nvutility.h"
+
+
+/*!
+    Page cache hints for the PFM bin and depth (index) files named in the PFM list file.  libpfm reads bins and
+    depth chains with a seek and a read per record so, on a cold cache, every one of them can wait on the disk.  We
+    don't read the files ourselves (their layout belongs to libpfm), we just tell the kernel what's coming.  The bin
+    file is stored a PFM row at a time so willNeed asks for the part of it that (roughly) holds a range of PFM rows.
+    The depth records aren't stored in any spatial order so, if the depth file is small enough compared to physical
+    memory, open asks for all of it.  Everything here is advice, if it fails (or on Windows) nothing changes except
+    the speed.  willNeed can be called from any thread.
+*/
+
+class pfmBagFileHints
+{
+public:
+
+  pfmBagFileHints ();
+  ~pfmBagFileHints ();
+
+  uint8_t open (const char *list_path, int32_t rows);
+  void willNeed (int32_t first_row, int32_t last_row);
+
+
+  QString          bin_path, ndx_path;
+
+  int64_t          bin_size, ndx_size;
+
+  uint8_t          ndx_loaded;
+
+
+protected:
+
+  int32_t          bin_fd, ndx_fd, bin_rows;
+};
+
+#endif
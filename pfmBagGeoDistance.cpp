@@ -0,0 +1,97 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include "pfmBagGeoDistance.hpp"
+
+#include "nvutility.h"
+
+
+/*!
+    Compute the local tangent plane constants for a row of cells at latitude lat.  The meters per degree come from the
+    WGS-84 meridional (M) and prime vertical (N) radii of curvature at lat.  Using the row's latitude instead of the
+    mean latitude of the two points scales the east-west distance by about 1 + tan (lat) * dlat / 2 (dlat in radians)
+    and the north-south distance by about 1 + 3e^2 sin (lat) cos (lat) * dlat / 2.  err_per_deg is twice the sum of
+    those so that the neglected higher order terms are covered.  Following a parallel instead of the great circle
+    adds about (d tan (lat) / N)^2 / 24 for a distance of d meters, err_per_m2 is three times that.
+*/
+
+void 
+geo_row (double lat, GEO_ROW *row)
+{
+  double e2 = 1.0 - (NV_B0 * NV_B0) / (NV_A0 * NV_A0);
+  double phi = lat * NV_DEG_TO_RAD;
+  double sin_phi = sin (phi), cos_phi = cos (phi);
+  double w2 = 1.0 - e2 * sin_phi * sin_phi;
+  double w = sqrt (w2);
+  double n = NV_A0 / w;
+  double m = NV_A0 * (1.0 - e2) / (w2 * w);
+
+
+  row->lat = lat;
+  row->m_per_deg_x = n * cos_phi * NV_DEG_TO_RAD;
+  row->m_per_deg_y = m * NV_DEG_TO_RAD;
+
+
+  //  Near the poles tan (lat) blows up, which just means we'll always use the ellipsoidal distance there.
+
+  double tan_phi = (fabs (cos_phi) > 1.0e-12) ? fabs (sin_phi / cos_phi) : 1.0e12;
+
+  row->err_per_deg = (tan_phi + 3.0 * e2 * fabs (sin_phi * cos_phi) / w2) * NV_DEG_TO_RAD;
+  row->err_per_m2 = (tan_phi / n) * (tan_phi / n) / 8.0;
+}
+
+
+
+/*!
+    Compute the tangent plane distances from count cells of a row, starting at longitude lon0 and spaced lon_step
+    degrees apart, to lat, lon.  This is a straight loop with no branches so the compiler can vectorize it.
+*/
+
+void 
+geo_row_distances (GEO_ROW *row, double lon0, double lon_step, int32_t count, double lat, double lon, double *dist)
+{
+  double dy = (row->lat - lat) * row->m_per_deg_y;
+  double dy2 = dy * dy;
+  double kx = row->m_per_deg_x;
+
+
+  for (int32_t j = 0 ; j < count ; j++)
+    {
+      double dx = (lon0 + (double) j * lon_step - lon) * kx;
+
+      dist[j] = sqrt (dx * dx + dy2);
+    }
+}
@@ -0,0 +1,99 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+#ifndef PFMBAGGEODISTANCE_H
+#define PFMBAGGEODISTANCE_H
+
+#include <math.h>
+#include <stdtypes.h>
+
+
+/*!
+    Largest relative error of the local tangent plane distance that we'll accept.  When a pair of points could be
+    farther apart than this (and close enough to matter) the ellipsoidal distance is used instead.
+*/
+
+#define GEO_DISTANCE_TOLERANCE  1.0e-4
+
+
+/*!
+    Local tangent plane constants for one row of geographic BAG cells.  m_per_deg_x and m_per_deg_y are the WGS-84
+    meters per degree of longitude and latitude at the row's latitude (lat).  err_per_deg bounds the relative error
+    of the approximation per degree of latitude between the row and the other point and err_per_m2 bounds the relative
+    error per square meter of distance (the curvature of the parallel, which matters near the poles).
+*/
+
+typedef struct
+{
+  double                       lat;
+  double                       m_per_deg_x;
+  double                       m_per_deg_y;
+  double                       err_per_deg;
+  double                       err_per_m2;
+} GEO_ROW;
+
+
+void geo_row (double lat, GEO_ROW *row);
+void geo_row_distances (GEO_ROW *row, double lon0, double lon_step, int32_t count, double lat, double lon, double *dist);
+
+
+//!  Local tangent plane distance (in meters) from a point in the row at longitude row_lon to lat, lon.
+
+inline double 
+geo_distance (GEO_ROW *row, double row_lon, double lat, double lon)
+{
+  double dx = (row_lon - lon) * row->m_per_deg_x;
+  double dy = (row->lat - lat) * row->m_per_deg_y;
+
+  return (sqrt (dx * dx + dy * dy));
+}
+
+
+/*!
+    Returns NVTrue if the tangent plane distance dist from the row to a point at latitude lat might be off by more than
+    GEO_DISTANCE_TOLERANCE and the point might be within radius.  The ellipsoidal distance has to be used for those.
+*/
+
+inline uint8_t 
+geo_needs_exact (GEO_ROW *row, double lat, double dist, double radius)
+{
+  double err = row->err_per_deg * fabs (lat - row->lat) + row->err_per_m2 * dist * dist;
+
+  return (err > GEO_DISTANCE_TOLERANCE && dist * (1.0 - err) < radius);
+}
+
+#endif
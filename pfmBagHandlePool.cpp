@@ -0,0 +1,132 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include "pfmBagHandlePool.hpp"
+
+
+pfmBagHandlePool::pfmBagHandlePool (const char *list_path, int32_t max_handles)
+{
+  strncpy (path, list_path, sizeof (path) - 1);
+  path[sizeof (path) - 1] = 0;
+
+  max_count = qMax (1, qMin (max_handles, MAX_POOL_HANDLES));
+  count = free_count = opened = 0;
+}
+
+
+
+pfmBagHandlePool::~pfmBagHandlePool ()
+{
+  for (int32_t i = 0 ; i < count ; i++) close_pfm_file (handle[i]);
+}
+
+
+
+/*!
+    Lease a handle, opening a new one if none are free and the pool isn't full.  Waits as long as it takes for a handle
+    to be released if they're all leased.  Returns -1 if the PFM couldn't be opened (pfm_error is set, check it before
+    anything else opens a PFM).
+*/
+
+int32_t 
+pfmBagHandlePool::lease ()
+{
+  return (take (NVTrue));
+}
+
+
+
+/*!
+    Lease a handle as lease does but don't wait for one to be released if they're all leased.  Returns LEASE_NONE_FREE
+    if there isn't one or -1 if the PFM couldn't be opened.
+*/
+
+int32_t 
+pfmBagHandlePool::tryLease ()
+{
+  return (take (NVFalse));
+}
+
+
+
+//  Lease a handle, waiting for one to be released if wait is set and they're all leased.
+
+int32_t 
+pfmBagHandlePool::take (uint8_t wait)
+{
+  QMutexLocker lock (&mutex);
+
+
+  while (!free_count && count >= max_count)
+    {
+      if (!wait) return (LEASE_NONE_FREE);
+
+      returned.wait (&mutex);
+    }
+
+  if (free_count) return (free_handle[--free_count]);
+
+
+  PFM_OPEN_ARGS args;
+
+  strcpy (args.list_path, path);
+  args.checkpoint = 0;
+
+  int32_t hnd = open_existing_pfm_file (&args);
+
+  if (hnd < 0) return (-1);
+
+  handle[count++] = hnd;
+  opened++;
+
+  return (hnd);
+}
+
+
+
+//  Give a leased handle back to the pool.
+
+void 
+pfmBagHandlePool::release (int32_t hnd)
+{
+  if (hnd < 0) return;
+
+  QMutexLocker lock (&mutex);
+
+  free_handle[free_count++] = hnd;
+
+  returned.wakeOne ();
+}
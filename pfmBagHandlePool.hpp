@@ -0,0 +1,101 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#ifndef PFMBAGHANDLEPOOL_H
+#define PFMBAGHANDLEPOOL_H
+
+#include <QtCore>
+#include <stdtypes.h>
+
+#include "pfm.h"
+
+
+//  Maximum number of PFM handles in the pool (a gridding handle and a read ahead handle for each of up to 32
+//  gridding threads).
+
+#define MAX_POOL_HANDLES   64
+
+
+//  What tryLease returns if every handle is leased and the pool is full.
+
+#define LEASE_NONE_FREE    -2
+
+
+/*!
+    A pool of read only (checkpoint 0) handles on the same PFM.  libpfm handles can't be shared between threads so
+    anything that reads the PFM from a worker thread leases a handle, uses it only in that thread, and gives it back.
+    Handles are opened the first time they're needed and reused after that, so a handle returned by one worker is
+    handed to the next one without reopening the PFM.  Opening (and closing) PFM files isn't thread safe in libpfm so
+    it's done under the pool's mutex.  If all max_handles handles are leased, lease waits for one to be released.
+    Callers that can't be sure a handle will ever come back (the engine leasing handles for threads that it hasn't
+    started yet) should use tryLease, which doesn't wait at all.  Any handles still open are closed when the pool is
+    deleted, so don't delete it while workers are reading.
+*/
+
+class pfmBagHandlePool
+{
+public:
+
+  pfmBagHandlePool (const char *list_path, int32_t max_handles);
+  ~pfmBagHandlePool ();
+
+  int32_t lease ();
+  int32_t tryLease ();
+  void release (int32_t handle);
+
+
+  int32_t          opened;                 //  Number of handles opened over the life of the pool
+
+
+protected:
+
+  QMutex           mutex;
+
+  QWaitCondition   returned;
+
+  char             path[1024];
+
+  int32_t          handle[MAX_POOL_HANDLES], count;           //  Every open handle
+
+  int32_t          free_handle[MAX_POOL_HANDLES], free_count; //  Open handles that aren't leased
+
+  int32_t          max_count;
+
+
+  int32_t take (uint8_t wait);
+};
+
+#endif
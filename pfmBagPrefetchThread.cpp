@@ -0,0 +1,282 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#include "pfmBagPrefetchThread.hpp"
+
+
+pfmBagPrefetchThread::pfmBagPrefetchThread (int32_t handle, int32_t first_col, int32_t last_col)
+{
+  pfm_handle = handle;
+  start_col = first_col;
+  cols = last_col - first_col + 1;
+  keep_row = 0;
+  end_row = next_row = -1;
+  stopped = NVFalse;
+  prefetched = 0;
+
+
+  //  If we can't allocate the column flags we just read every column.
+
+  want = (uint8_t *) malloc (cols * sizeof (uint8_t));
+  row_want = (uint8_t *) malloc (cols * sizeof (uint8_t));
+
+  if (want == NULL || row_want == NULL)
+    {
+      free (want);
+      free (row_want);
+      want = row_want = NULL;
+    }
+  else
+    {
+      memset (want, 1, cols);
+    }
+
+
+  for (int32_t i = 0 ; i < PREFETCH_MAX_ROWS ; i++)
+    {
+      slot[i].row = -1;
+      slot[i].batch = NULL;
+      slot[i].ready = NULL;
+    }
+}
+
+
+
+pfmBagPrefetchThread::~pfmBagPrefetchThread ()
+{
+  for (int32_t i = 0 ; i < PREFETCH_MAX_ROWS ; i++)
+    {
+      clearSlot (&slot[i]);
+      free (slot[i].batch);
+      free (slot[i].ready);
+    }
+
+  free (want);
+  free (row_want);
+}
+
+
+
+//  Free the batches in a slot (but not the slot's arrays, we'll reuse those).
+
+void 
+pfmBagPrefetchThread::clearSlot (PREFETCH_ROW *sl)
+{
+  if (sl->batch && sl->ready)
+    {
+      for (int32_t n = 0 ; n < cols ; n++)
+        {
+          free_soundings (&sl->batch[n]);
+          sl->ready[n] = NVFalse;
+        }
+    }
+
+  sl->row = -1;
+}
+
+
+
+/*!
+    Ask for PFM rows first_row through last_row.  Anything below first_row is no longer needed.  If the engine jumped
+    (i.e. a gridding thread started a new band) we start reading from first_row again.  Only the PFM columns in the
+    ranges col_range[2 * i] through col_range[2 * i + 1] (i from 0 to ranges - 1, they may overlap) are read, or every
+    column if col_range is NULL.
+*/
+
+void 
+pfmBagPrefetchThread::request (int32_t first_row, int32_t last_row, const int32_t *col_range, int32_t ranges)
+{
+  QMutexLocker lock (&mutex);
+
+
+  if (want)
+    {
+      if (col_range == NULL)
+        {
+          memset (want, 1, cols);
+        }
+      else
+        {
+          memset (want, 0, cols);
+
+          for (int32_t i = 0 ; i < ranges ; i++)
+            {
+              int32_t first = qMax (col_range[2 * i], start_col) - start_col;
+              int32_t last = qMin (col_range[2 * i + 1], start_col + cols - 1) - start_col;
+
+              if (first <= last) memset (&want[first], 1, last - first + 1);
+            }
+        }
+    }
+
+
+  if (first_row < keep_row || first_row > next_row) next_row = first_row;
+
+  keep_row = first_row;
+  end_row = qMin (last_row, first_row + PREFETCH_MAX_ROWS - 1);
+
+
+  for (int32_t i = 0 ; i < PREFETCH_MAX_ROWS ; i++)
+    {
+      if (slot[i].row >= 0 && (slot[i].row < keep_row || slot[i].row > end_row)) clearSlot (&slot[i]);
+    }
+
+
+  wake.wakeAll ();
+}
+
+
+
+//  Take the decoded depth array for PFM cell coord out of the ready buffer (the caller owns the batch's arrays after
+//  that).  Returns NVFalse if it hasn't been read (yet).
+
+uint8_t 
+pfmBagPrefetchThread::take (NV_I32_COORD2 coord, SOUNDING_BATCH *batch)
+{
+  QMutexLocker lock (&mutex);
+
+
+  if (coord.y < 0 || coord.x < start_col || coord.x >= start_col + cols) return (NVFalse);
+
+  PREFETCH_ROW *sl = &slot[coord.y % PREFETCH_MAX_ROWS];
+  int32_t n = coord.x - start_col;
+
+  if (sl->row != coord.y || !sl->ready[n]) return (NVFalse);
+
+
+  *batch = sl->batch[n];
+  clear_soundings (&sl->batch[n]);
+  sl->ready[n] = NVFalse;
+
+  prefetched++;
+
+  return (NVTrue);
+}
+
+
+
+void 
+pfmBagPrefetchThread::stop ()
+{
+  QMutexLocker lock (&mutex);
+
+  stopped = NVTrue;
+  wake.wakeAll ();
+}
+
+
+
+void 
+pfmBagPrefetchThread::run ()
+{
+  mutex.lock ();
+
+  while (!stopped)
+    {
+      //  Skip rows that we already have.
+
+      while (next_row <= end_row && slot[next_row % PREFETCH_MAX_ROWS].row == next_row) next_row++;
+
+
+      if (next_row > end_row)
+        {
+          wake.wait (&mutex);
+          continue;
+        }
+
+
+      //  Since the requested rows never span more than PREFETCH_MAX_ROWS rows, the slot for this row is empty (request
+      //  cleared whatever was in it) and nobody else will touch it until we set its row.
+
+      int32_t m = next_row++;
+      PREFETCH_ROW *sl = &slot[m % PREFETCH_MAX_ROWS];
+
+      if (want) memcpy (row_want, want, cols);
+
+      mutex.unlock ();
+
+
+      if (sl->batch == NULL) sl->batch = (SOUNDING_BATCH *) calloc (cols, sizeof (SOUNDING_BATCH));
+      if (sl->ready == NULL) sl->ready = (uint8_t *) calloc (cols, sizeof (uint8_t));
+
+      uint8_t ok = (sl->batch != NULL && sl->ready != NULL);
+
+      if (ok)
+        {
+          NV_I32_COORD2 coord;
+          coord.y = m;
+
+          for (int32_t n = 0 ; n < cols ; n++)
+            {
+              if (row_want && !row_want[n]) continue;
+
+
+              DEPTH_RECORD *depth;
+              int32_t numrecs;
+
+              coord.x = start_col + n;
+
+
+              //  If the read or the decode fails the depth cache will try again itself.
+
+              if (!read_depth_array_index (pfm_handle, coord, &depth, &numrecs))
+                {
+                  sl->ready[n] = decode_soundings (depth, numrecs, &sl->batch[n]);
+                  free (depth);
+                }
+            }
+        }
+
+
+      mutex.lock ();
+
+
+      //  The engine may have moved on while we were reading.
+
+      if (ok && m >= keep_row && m <= end_row)
+        {
+          sl->row = m;
+        }
+      else
+        {
+          clearSlot (sl);
+        }
+    }
+
+  mutex.unlock ();
+}
@@ -0,0 +1,114 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#ifndef PFMBAGPREFETCHTHREAD_H
+#define PFMBAGPREFETCHTHREAD_H
+
+#include <QtCore>
+#include <stdtypes.h>
+
+#include "pfm.h"
+
+#include "pfmBagSoundings.hpp"
+
+
+//  Maximum number of PFM rows of depth arrays that the read ahead thread will hold.
+
+#define PREFETCH_MAX_ROWS  32
+
+
+/*!
+    One row of (decoded) depth arrays in the read ahead buffer.  PFM row m is always kept in slot m % PREFETCH_MAX_ROWS.
+    The batch and ready arrays (cols long) are allocated the first time the slot is used and reused after that.
+*/
+
+typedef struct
+{
+  int32_t          row;                    //  PFM row in the slot (-1 if none)
+  SOUNDING_BATCH   *batch;
+  uint8_t          *ready;                 //  NVFalse if the read failed or the batch has been taken
+} PREFETCH_ROW;
+
+
+
+/*!
+    Read ahead thread for the gather gridding engine.  While a BAG row is being gridded the engine asks for the PFM
+    rows that cover the next few BAG rows and this thread reads their depth arrays and decodes them (decode_soundings)
+    into a ready buffer using its own PFM handle.  Only the columns (between start_col and start_col + cols - 1) that
+    the engine says cover cells inside the area polygon are read (want, set by request).  A row is read with the
+    columns wanted when the thread gets to it, anything wanted later is left to the depth cache.  pfmBagDepthCache
+    takes the batches out of the ready buffer instead of reading and decoding them itself.  Rows below keep_row are
+    thrown away when the engine moves on.  The engine owns the PFM handle, it has to stop the thread before closing
+    it.
+*/
+
+class pfmBagPrefetchThread : public QThread
+{
+public:
+
+  pfmBagPrefetchThread (int32_t handle, int32_t first_col, int32_t last_col);
+  ~pfmBagPrefetchThread ();
+
+  void request (int32_t first_row, int32_t last_row, const int32_t *col_range, int32_t ranges);
+  uint8_t take (NV_I32_COORD2 coord, SOUNDING_BATCH *batch);
+  void stop ();
+
+
+  int64_t          prefetched;
+
+
+protected:
+
+  void run ();
+  void clearSlot (PREFETCH_ROW *sl);
+
+
+  QMutex           mutex;
+
+  QWaitCondition   wake;
+
+  PREFETCH_ROW     slot[PREFETCH_MAX_ROWS];
+
+  uint8_t          *want, *row_want;       //  Columns to read (NULL - all of them), and the copy the thread reads with
+
+  int32_t          pfm_handle, start_col, cols, keep_row, end_row, next_row;
+
+  uint8_t          stopped;
+};
+
+#endif
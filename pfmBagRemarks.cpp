@@ -0,0 +1,295 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include "pfmBagRemarks.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+
+//  The pfmFeature remarks fields that we need are in the first REMARK_FIELDS comma separated fields.
+
+#define REMARK_FIELDS     7
+
+
+//  Most significant digits we hand to strtod.  A double never needs more than 768 to be rounded correctly so any
+//  beyond this are replaced by a single nonzero digit (which only matters for breaking ties).
+
+#define REMARK_DIGITS     800
+
+
+typedef struct
+{
+  const char                   *start;
+  const char                   *end;
+} REMARK_FIELD;
+
+
+
+//  Narrow the field to section n of it (separated by sep).  This works the same way as QString::section (sep, n, n),
+//  a missing section is empty.
+
+static void 
+remark_section (REMARK_FIELD *field, char sep, int32_t n)
+{
+  const char *ptr = field->start;
+
+  for (int32_t i = 0 ; i < n ; i++)
+    {
+      while (ptr < field->end && *ptr != sep) ptr++;
+
+      if (ptr == field->end)
+        {
+          field->start = field->end;
+          return;
+        }
+
+      ptr++;
+    }
+
+  field->start = ptr;
+
+  while (ptr < field->end && *ptr != sep) ptr++;
+
+  field->end = ptr;
+}
+
+
+
+//  Convert the field to a double the way QString::toDouble does.  Leading and trailing white space is ignored and
+//  anything that isn't entirely a decimal number is 0.0.  The syntax is checked here and the number is rewritten in
+//  a stack buffer as its significant digits and a decimal exponent (so it's never longer than REMARK_DIGITS digits and
+//  has no decimal point for the locale to get wrong).  The conversion itself is done by strtod so the result is
+//  correctly rounded.
+
+static double 
+remark_number (REMARK_FIELD field)
+{
+  char number[REMARK_DIGITS + 16];
+  const char *ptr, *end, *int_start, *int_end, *frac_start = NULL, *frac_end = NULL;
+  int64_t exponent = 0;
+  int32_t len = 0;
+
+
+  ptr = field.start;
+  end = field.end;
+
+  while (ptr < end && (*ptr == ' ' || (*ptr >= '\t' && *ptr <= '\r'))) ptr++;
+  while (end > ptr && (end[-1] == ' ' || (end[-1] >= '\t' && end[-1] <= '\r'))) end--;
+
+  if (ptr == end) return (0.0);
+
+
+  if (*ptr == '+' || *ptr == '-')
+    {
+      if (*ptr == '-') number[len++] = '-';
+      ptr++;
+    }
+
+  int_start = ptr;
+  while (ptr < end && *ptr >= '0' && *ptr <= '9') ptr++;
+  int_end = ptr;
+
+  if (ptr < end && *ptr == '.')
+    {
+      frac_start = ++ptr;
+      while (ptr < end && *ptr >= '0' && *ptr <= '9') ptr++;
+      frac_end = ptr;
+    }
+
+  if (int_start == int_end && frac_start == frac_end) return (0.0);
+
+  if (ptr < end && (*ptr == 'e' || *ptr == 'E'))
+    {
+      int32_t sign = 1;
+      const char *exp_start;
+
+      ptr++;
+      if (ptr < end && (*ptr == '+' || *ptr == '-')) sign = (*ptr++ == '-') ? -1 : 1;
+
+      exp_start = ptr;
+
+      for ( ; ptr < end && *ptr >= '0' && *ptr <= '9' ; ptr++)
+        {
+          if (exponent < 1000000000) exponent = exponent * 10 + (*ptr - '0');
+        }
+
+      if (ptr == exp_start) return (0.0);
+
+      exponent *= sign;
+    }
+
+  if (ptr != end) return (0.0);
+
+
+  //  Copy the significant digits (counting the fraction digits in the exponent).  If there are more than
+  //  REMARK_DIGITS of them the rest only scale the number and, if any of them aren't zero, nudge it up a bit.
+
+  int32_t digits = 0, total = 0;
+  uint8_t sticky = NVFalse;
+
+  for (int32_t part = 0 ; part < 2 ; part++)
+    {
+      const char *p = part ? frac_start : int_start, *p_end = part ? frac_end : int_end;
+
+      for ( ; p < p_end ; p++)
+        {
+          if (part) exponent--;
+
+          if (*p == '0' && !total) continue;
+
+          total++;
+
+          if (digits < REMARK_DIGITS)
+            {
+              number[len + digits++] = *p;
+            }
+          else if (*p != '0')
+            {
+              sticky = NVTrue;
+            }
+        }
+    }
+
+  exponent += total - digits;
+
+  if (sticky)
+    {
+      number[len + digits++] = '1';
+      exponent--;
+    }
+
+  if (!digits) number[len + digits++] = '0';
+
+  len += digits;
+
+
+  //  Anything this far out is 0 or infinity (as strtod sees it) whatever the digits are.
+
+  exponent = (exponent < -99999) ? -99999 : (exponent > 99999) ? 99999 : exponent;
+
+  sprintf (&number[len], "e%d", (int32_t) exponent);
+
+
+  return (strtod (number, NULL));
+}
+
+
+
+/*!
+    Compute the enhanced surface search radius of a feature from its remarks.  For features selected by pfmFeature
+    it's based on the "max dist" or "bin size" fields of the remarks plus the horizontal error, otherwise it's
+    non_radius.  The remarks are split into fields once, without allocating, and the result is the same as the
+    QString::section/toDouble parsing that this replaced.
+
+    This is the description of how we defined the search radius prior to adding the "max dist" output to the feature
+    remarks in pfmFeature.  If it is available we'll use the max dist otherwise we'll use the method described below.
+
+    When running pfmFeature we use bin sizes of 3, 6, 12, and 24 meters (for IHO order 1).  To understand how we apply
+    the search radius for the bin sizes from pfmFeature you have to visualize possible locations for the shoalest point
+    in the center bin.  If the shoalest point is in the lower left corner of the bin then the maximum distance that a
+    trigger point (nearest point that meets IHO criteria) can be from the shoal point (assuming 3 meter bins) is 7.071
+    meters.  That would be if the trigger point is in the upper right corner of the upper right bin cell.  The effect
+    of this would be that the maximum distance of the trigger point from the shoal point in the opposite direction
+    would only be 2.83 meters.  To get a balanced search radius to be used for our enhanced surface we will assume that
+    the shoalest point is exactly in the center of the center bin.  In that case the maximum distance in any direction
+    to the trigger point would be 4.95 meters.  That is the sum of the diagonal of a square that is half the bin size
+    plus the diagonal of a square that is two thirds of the bin size (i.e. in the upper right corner of the upper right
+    bin cell).
+*/
+
+double 
+feature_radius (const char *remarks, double non_radius)
+{
+  REMARK_FIELD field[REMARK_FIELDS];
+  const char *ptr = remarks;
+  double radius;
+
+
+  if (strstr (remarks, "pfmFeature") == NULL || strstr (remarks, ", bin size ") == NULL) return (non_radius);
+
+
+  //  Split the first REMARK_FIELDS fields on commas.
+
+  for (int32_t i = 0 ; i < REMARK_FIELDS ; i++)
+    {
+      field[i].start = ptr;
+
+      while (*ptr && *ptr != ',') ptr++;
+
+      field[i].end = ptr;
+
+      if (*ptr) ptr++;
+    }
+
+
+  //  Check for the "max dist" string in the feature record.
+
+  if (strstr (remarks, ", max dist ") != NULL)
+    {
+      REMARK_FIELD max_dist = field[6];
+
+      remark_section (&max_dist, ' ', 3);
+      radius = remark_number (max_dist);
+    }
+  else
+    {
+      REMARK_FIELD bin = field[2];
+
+      remark_section (&bin, ' ', 3);
+
+      double bin_size = remark_number (bin);
+      double half = bin_size / 2.0L;
+      double two_thirds = bin_size * 2.0L / 3.0L;
+      double half_square = half * half;
+      double two_thirds_square = two_thirds * two_thirds;
+      radius = sqrt (half_square + half_square) + sqrt (two_thirds_square + two_thirds_square);
+    }
+
+
+  //  Add the horizontal error to the radius.
+
+  REMARK_FIELD error = field[4];
+
+  remark_section (&error, '/', 1);
+  remark_section (&error, ' ', 1);
+  radius += remark_number (error);
+
+
+  return (radius);
+}
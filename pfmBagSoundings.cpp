@@ -0,0 +1,442 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include "pfmBagSoundings.hpp"
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define SOUNDINGS_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined (__aarch64__)
+#define SOUNDINGS_NEON
+#include <arm_neon.h>
+#endif
+
+
+//  Validity flags that keep a sounding out of the surface.
+
+#define SOUNDING_REJECT  (PFM_INVAL | PFM_DELETED | PFM_REFERENCE)
+
+
+typedef void (*SOUNDING_KERNEL) (SOUNDING_BATCH *batch, NV_F64_COORD2 *xy, CELL_STATS *st);
+
+
+
+void 
+clear_soundings (SOUNDING_BATCH *batch)
+{
+  batch->count = batch->size = 0;
+  batch->x = batch->y = batch->z = batch->verr = NULL;
+  batch->valid = NULL;
+}
+
+
+
+void 
+free_soundings (SOUNDING_BATCH *batch)
+{
+  free (batch->x);
+  free (batch->y);
+  free (batch->z);
+  free (batch->verr);
+  free (batch->valid);
+  clear_soundings (batch);
+}
+
+
+
+/*!
+    Decode numrecs depth records into batch, growing the arrays if needed.  Returns NVFalse if we run out of memory
+    (the batch is freed).
+*/
+
+uint8_t 
+decode_soundings (DEPTH_RECORD *depth, int32_t numrecs, SOUNDING_BATCH *batch)
+{
+  int32_t padded = ((numrecs + SOUNDING_PAD - 1) / SOUNDING_PAD) * SOUNDING_PAD;
+
+
+  if (padded > batch->size)
+    {
+      int32_t new_size = qMax (padded, batch->size * 2);
+      int32_t words = (new_size + 63) / 64;
+
+      double *x = (double *) realloc (batch->x, new_size * sizeof (double));
+      if (x) batch->x = x;
+      double *y = (double *) realloc (batch->y, new_size * sizeof (double));
+      if (y) batch->y = y;
+      double *z = (double *) realloc (batch->z, new_size * sizeof (double));
+      if (z) batch->z = z;
+      double *verr = (double *) realloc (batch->verr, new_size * sizeof (double));
+      if (verr) batch->verr = verr;
+      uint64_t *valid = (uint64_t *) realloc (batch->valid, words * sizeof (uint64_t));
+      if (valid) batch->valid = valid;
+
+      if (x == NULL || y == NULL || z == NULL || verr == NULL || valid == NULL)
+        {
+          free_soundings (batch);
+          return (NVFalse);
+        }
+
+      batch->size = new_size;
+    }
+
+
+  memset (batch->valid, 0, ((padded + 63) / 64) * sizeof (uint64_t));
+
+  for (int32_t p = 0 ; p < numrecs ; p++)
+    {
+      batch->x[p] = depth[p].xyz.x;
+      batch->y[p] = depth[p].xyz.y;
+      batch->z[p] = depth[p].xyz.z;
+      batch->verr[p] = depth[p].vertical_error;
+
+      if (!(depth[p].validity & SOUNDING_REJECT)) batch->valid[p >> 6] |= (uint64_t) 1 << (p & 63);
+    }
+
+  for (int32_t p = numrecs ; p < padded ; p++) batch->x[p] = batch->y[p] = batch->z[p] = batch->verr[p] = 0.0;
+
+  batch->count = numrecs;
+
+  return (NVTrue);
+}
+
+
+
+//  Memory that decode_soundings allocates for numrecs soundings in an empty batch.
+
+int64_t 
+sounding_bytes (int32_t numrecs)
+{
+  int64_t padded = ((numrecs + SOUNDING_PAD - 1) / SOUNDING_PAD) * SOUNDING_PAD;
+
+  return (padded * 4 * sizeof (double) + ((padded + 63) / 64) * sizeof (uint64_t));
+}
+
+
+
+//  The four (or SOUNDING_PAD) valid bits of the group of soundings that starts at p.
+
+static inline uint32_t 
+group_bits (SOUNDING_BATCH *batch, int32_t p, int32_t n)
+{
+  return ((uint32_t) (batch->valid[p >> 6] >> (p & 63)) & ((1 << n) - 1));
+}
+
+
+
+/*!
+    Fold the per lane minimum depths (and the uncertainty and index of the sounding that set them) into the cell
+    statistics.  The scalar loop keeps the uncertainty of the last sounding with the minimum depth so ties go to the
+    highest index, and soundings in this batch come after anything already in the cell.
+*/
+
+static void 
+fold_min (double *lane_min, double *lane_unc, double *lane_idx, int32_t lanes, CELL_STATS *st)
+{
+  int32_t best = -1;
+
+  for (int32_t l = 0 ; l < lanes ; l++)
+    {
+      if (lane_idx[l] < 0.0) continue;
+
+      if (best < 0 || lane_min[l] < lane_min[best] || (lane_min[l] == lane_min[best] && lane_idx[l] > lane_idx[best])) best = l;
+    }
+
+  if (best >= 0 && lane_min[best] <= st->min_z)
+    {
+      st->min_z = lane_min[best];
+      st->min_uncert = lane_unc[best];
+    }
+}
+
+
+
+/*!
+    Add one sounding to the running sums.  All of the kernels go through here, one sounding at a time in index order,
+    so the sums come out the same whichever kernel is used.
+*/
+
+static inline void 
+add_sums (CELL_STATS *st, double z, double verr)
+{
+  st->sum += z;
+  st->sum2 += z * z;
+  st->uncert_sum += verr;
+  st->uncert_sum2 += verr * verr;
+}
+
+
+
+//  Scalar kernel, the same tests and sums as pfmBagEngine::addSounding one sounding at a time.
+
+static void 
+accumulate_scalar (SOUNDING_BATCH *batch, NV_F64_COORD2 *xy, CELL_STATS *st)
+{
+  for (int32_t p = 0 ; p < batch->count ; p++)
+    {
+      if (!((batch->valid[p >> 6] >> (p & 63)) & 1)) continue;
+
+      double x = batch->x[p], y = batch->y[p], z = batch->z[p], verr = batch->verr[p];
+
+      if (x < xy[0].x || x > xy[1].x || y < xy[0].y || y > xy[1].y) continue;
+
+      if (z <= st->min_z)
+        {
+          st->min_uncert = verr;
+          st->min_z = z;
+        }
+
+      st->max_z = qMax (st->max_z, z);
+
+      add_sums (st, z, verr);
+      st->count++;
+    }
+}
+
+
+
+#ifdef SOUNDINGS_AVX2
+
+/*!
+    AVX2 kernel, four soundings at a time.  Only called if the processor supports AVX2.  The bounds tests and the
+    minimum and maximum are done four wide, the sums are added one sounding at a time in index order.
+*/
+
+__attribute__ ((target ("avx2"))) static void 
+accumulate_avx2 (SOUNDING_BATCH *batch, NV_F64_COORD2 *xy, CELL_STATS *st)
+{
+  const __m256i bit = _mm256_set_epi64x (8, 4, 2, 1);
+  const __m256d min_x = _mm256_set1_pd (xy[0].x), max_x = _mm256_set1_pd (xy[1].x);
+  const __m256d min_y = _mm256_set1_pd (xy[0].y), max_y = _mm256_set1_pd (xy[1].y);
+  const __m256d four = _mm256_set1_pd (4.0);
+
+  __m256d lmin = _mm256_set1_pd (st->min_z), lmax = _mm256_set1_pd (st->max_z);
+  __m256d lunc = _mm256_setzero_pd (), lidx = _mm256_set1_pd (-1.0);
+  __m256d idx = _mm256_set_pd (3.0, 2.0, 1.0, 0.0);
+  int32_t count = 0;
+
+
+  for (int32_t p = 0 ; p < batch->count ; p += 4, idx = _mm256_add_pd (idx, four))
+    {
+      uint32_t bits = group_bits (batch, p, 4);
+
+      if (!bits) continue;
+
+      __m256d x = _mm256_loadu_pd (&batch->x[p]);
+      __m256d y = _mm256_loadu_pd (&batch->y[p]);
+
+      __m256d mask = _mm256_castsi256_pd (_mm256_cmpeq_epi64 (_mm256_and_si256 (_mm256_set1_epi64x (bits), bit), bit));
+      mask = _mm256_and_pd (mask, _mm256_cmp_pd (x, min_x, _CMP_GE_OQ));
+      mask = _mm256_and_pd (mask, _mm256_cmp_pd (x, max_x, _CMP_LE_OQ));
+      mask = _mm256_and_pd (mask, _mm256_cmp_pd (y, min_y, _CMP_GE_OQ));
+      mask = _mm256_and_pd (mask, _mm256_cmp_pd (y, max_y, _CMP_LE_OQ));
+
+      int32_t hits = _mm256_movemask_pd (mask);
+
+      if (!hits) continue;
+
+      count += __builtin_popcount (hits);
+
+      for (int32_t l = 0 ; l < 4 ; l++)
+        {
+          if (hits & (1 << l)) add_sums (st, batch->z[p + l], batch->verr[p + l]);
+        }
+
+      __m256d z = _mm256_loadu_pd (&batch->z[p]);
+      __m256d verr = _mm256_loadu_pd (&batch->verr[p]);
+
+      __m256d upd = _mm256_and_pd (mask, _mm256_cmp_pd (z, lmin, _CMP_LE_OQ));
+      lmin = _mm256_blendv_pd (lmin, z, upd);
+      lunc = _mm256_blendv_pd (lunc, verr, upd);
+      lidx = _mm256_blendv_pd (lidx, idx, upd);
+
+      lmax = _mm256_blendv_pd (lmax, _mm256_max_pd (lmax, z), mask);
+    }
+
+
+  if (!count) return;
+
+  double lane[4][4];
+
+  _mm256_storeu_pd (lane[0], lmin);
+  _mm256_storeu_pd (lane[1], lunc);
+  _mm256_storeu_pd (lane[2], lidx);
+  _mm256_storeu_pd (lane[3], lmax);
+
+  fold_min (lane[0], lane[1], lane[2], 4, st);
+
+  for (int32_t l = 0 ; l < 4 ; l++) st->max_z = qMax (st->max_z, lane[3][l]);
+
+  st->count += count;
+}
+
+#endif
+
+
+
+#ifdef SOUNDINGS_NEON
+
+/*!
+    NEON kernel, two soundings at a time.  NEON is always there on AArch64.  As with the AVX2 kernel the sums are
+    added one sounding at a time in index order.
+*/
+
+static void 
+accumulate_neon (SOUNDING_BATCH *batch, NV_F64_COORD2 *xy, CELL_STATS *st)
+{
+  const uint64_t bit_lanes[2] = {1, 2};
+  const uint64x2_t bit = vld1q_u64 (bit_lanes);
+  const float64x2_t min_x = vdupq_n_f64 (xy[0].x), max_x = vdupq_n_f64 (xy[1].x);
+  const float64x2_t min_y = vdupq_n_f64 (xy[0].y), max_y = vdupq_n_f64 (xy[1].y);
+  const float64x2_t two = vdupq_n_f64 (2.0);
+  const double idx_lanes[2] = {0.0, 1.0};
+
+  float64x2_t lmin = vdupq_n_f64 (st->min_z), lmax = vdupq_n_f64 (st->max_z);
+  float64x2_t lunc = vdupq_n_f64 (0.0), lidx = vdupq_n_f64 (-1.0);
+  float64x2_t idx = vld1q_f64 (idx_lanes);
+  int32_t count = 0;
+
+
+  for (int32_t p = 0 ; p < batch->count ; p += 2, idx = vaddq_f64 (idx, two))
+    {
+      uint32_t bits = group_bits (batch, p, 2);
+
+      if (!bits) continue;
+
+      float64x2_t x = vld1q_f64 (&batch->x[p]);
+      float64x2_t y = vld1q_f64 (&batch->y[p]);
+
+      uint64x2_t mask = vceqq_u64 (vandq_u64 (vdupq_n_u64 (bits), bit), bit);
+      mask = vandq_u64 (mask, vcgeq_f64 (x, min_x));
+      mask = vandq_u64 (mask, vcleq_f64 (x, max_x));
+      mask = vandq_u64 (mask, vcgeq_f64 (y, min_y));
+      mask = vandq_u64 (mask, vcleq_f64 (y, max_y));
+
+      int32_t hits = (int32_t) (vgetq_lane_u64 (mask, 0) & 1) | ((int32_t) (vgetq_lane_u64 (mask, 1) & 1) << 1);
+
+      if (!hits) continue;
+
+      count += __builtin_popcount (hits);
+
+      for (int32_t l = 0 ; l < 2 ; l++)
+        {
+          if (hits & (1 << l)) add_sums (st, batch->z[p + l], batch->verr[p + l]);
+        }
+
+      float64x2_t z = vld1q_f64 (&batch->z[p]);
+      float64x2_t verr = vld1q_f64 (&batch->verr[p]);
+
+      uint64x2_t upd = vandq_u64 (mask, vcleq_f64 (z, lmin));
+      lmin = vbslq_f64 (upd, z, lmin);
+      lunc = vbslq_f64 (upd, verr, lunc);
+      lidx = vbslq_f64 (upd, idx, lidx);
+
+      lmax = vbslq_f64 (mask, vmaxq_f64 (lmax, z), lmax);
+    }
+
+
+  if (!count) return;
+
+  double lane[3][2];
+
+  vst1q_f64 (lane[0], lmin);
+  vst1q_f64 (lane[1], lunc);
+  vst1q_f64 (lane[2], lidx);
+
+  fold_min (lane[0], lane[1], lane[2], 2, st);
+
+  st->max_z = qMax (st->max_z, vmaxvq_f64 (lmax));
+
+  st->count += count;
+}
+
+#endif
+
+
+
+//  Pick the kernel for this processor (once).
+
+static SOUNDING_KERNEL 
+select_kernel (const char **name)
+{
+#ifdef SOUNDINGS_AVX2
+  __builtin_cpu_init ();
+
+  if (__builtin_cpu_supports ("avx2"))
+    {
+      *name = "AVX2";
+      return (accumulate_avx2);
+    }
+#endif
+
+#ifdef SOUNDINGS_NEON
+  *name = "NEON";
+  return (accumulate_neon);
+#endif
+
+  *name = "scalar";
+  return (accumulate_scalar);
+}
+
+
+
+static const char *kernel_name = NULL;
+static SOUNDING_KERNEL kernel = select_kernel (&kernel_name);
+
+
+
+/*!
+    Add the valid soundings in batch that fall within the xy[0] to xy[1] box (inclusive) to the cell statistics st.
+    All of the kernels add the sums in index order so the results are exactly the same as the scalar kernel's.
+*/
+
+void 
+accumulate_soundings (SOUNDING_BATCH *batch, NV_F64_COORD2 *xy, CELL_STATS *st)
+{
+  (*kernel) (batch, xy, st);
+}
+
+
+
+//  Name of the kernel that accumulate_soundings uses (for the process status list).
+
+const char *
+sounding_kernel ()
+{
+  return (kernel_name);
+}
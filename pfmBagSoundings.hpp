@@ -0,0 +1,96 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#ifndef PFMBAGSOUNDINGS_H
+#define PFMBAGSOUNDINGS_H
+
+#include <QtCore>
+#include <stdtypes.h>
+
+#include "nvutility.h"
+
+#include "pfm.h"
+
+
+/*!
+    Running statistics of the soundings that fall in a BAG cell.
+*/
+
+typedef struct
+{
+  double                       sum;
+  double                       sum2;
+  double                       uncert_sum;
+  double                       uncert_sum2;
+  double                       min_uncert;
+  double                       min_z;
+  double                       max_z;
+  int32_t                      count;
+} CELL_STATS;
+
+
+
+/*!
+    A depth array decoded into a structure of arrays so that the gathering kernel can test and accumulate several
+    soundings at a time.  Bit p of valid is set if sounding p isn't invalid, deleted, or a reference sounding.  The
+    arrays are grow-only, size is the number of soundings they have room for.  The arrays are padded (with zeros and
+    clear valid bits) to a multiple of SOUNDING_PAD soundings so the kernels don't need a scalar tail.
+*/
+
+#define SOUNDING_PAD  4
+
+typedef struct
+{
+  int32_t                      count;
+  int32_t                      size;
+  double                       *x;
+  double                       *y;
+  double                       *z;
+  double                       *verr;
+  uint64_t                     *valid;
+} SOUNDING_BATCH;
+
+
+void clear_soundings (SOUNDING_BATCH *batch);
+void free_soundings (SOUNDING_BATCH *batch);
+uint8_t decode_soundings (DEPTH_RECORD *depth, int32_t numrecs, SOUNDING_BATCH *batch);
+int64_t sounding_bytes (int32_t numrecs);
+void accumulate_soundings (SOUNDING_BATCH *batch, NV_F64_COORD2 *xy, CELL_STATS *st);
+const char *sounding_kernel ();
+
+#endif
@@ -0,0 +1,126 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#include "pfmBagThread.hpp"
+
+
+pfmBagThread::pfmBagThread (CONVERT_OPTIONS *op, QObject *parent):
+  QThread (parent)
+{
+  options = *op;
+  status = NVFalse;
+
+  for (int32_t i = 0 ; i < 3 ; i++) range_max[i] = 0;
+}
+
+
+
+pfmBagThread::~pfmBagThread ()
+{
+}
+
+
+
+//  Returns NVTrue if the conversion finished without errors.  Only meaningful after the finished signal.
+
+uint8_t 
+pfmBagThread::success ()
+{
+  return (status);
+}
+
+
+
+void 
+pfmBagThread::run ()
+{
+  pfmBagEngine engine (&options, this);
+
+  status = engine.run ();
+}
+
+
+
+void 
+pfmBagThread::progressRange (int32_t stage, int32_t min, int32_t max)
+{
+  range_max[stage] = max;
+
+
+  //  Invalidate the timer so that the first value for this stage is always sent.
+
+  timer[stage].invalidate ();
+
+  emit rangeSignal (stage, min, max);
+}
+
+
+
+void 
+pfmBagThread::progressValue (int32_t stage, int32_t value)
+{
+  if (value < range_max[stage] && timer[stage].isValid () && timer[stage].elapsed () < PROGRESS_INTERVAL) return;
+
+  timer[stage].start ();
+
+  emit progressSignal (stage, value);
+}
+
+
+
+void 
+pfmBagThread::statusMessage (QString msg)
+{
+  emit messageSignal (msg);
+}
+
+
+
+void 
+pfmBagThread::warningMessage (QString msg)
+{
+  emit warningSignal (msg);
+}
+
+
+
+void 
+pfmBagThread::errorMessage (QString msg)
+{
+  emit errorSignal (msg);
+}
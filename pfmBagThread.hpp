@@ -0,0 +1,99 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#ifndef PFMBAGTHREAD_H
+#define PFMBAGTHREAD_H
+
+#include "pfmBagDef.hpp"
+
+
+//  Minimum time (in milliseconds) between progress signals (i.e. at most 10 updates per second).
+
+#define PROGRESS_INTERVAL  100
+
+
+/*!
+    Runs pfmBagEngine in a worker thread so that the GUI thread only has to update the progress bars and the
+    process status list.  The engine callbacks are turned into (queued) signals.  Progress signals are throttled
+    to one every PROGRESS_INTERVAL milliseconds per stage (plus the last value of each stage) so that a 20000 row
+    BAG doesn't flood the GUI event queue.
+*/
+
+class pfmBagThread : public QThread, public pfmBagCallback
+{
+  Q_OBJECT
+
+
+public:
+
+  pfmBagThread (CONVERT_OPTIONS *op, QObject *parent = 0);
+  ~pfmBagThread ();
+
+  uint8_t success ();
+
+
+signals:
+
+  void rangeSignal (int stage, int min, int max);
+  void progressSignal (int stage, int value);
+  void messageSignal (QString msg);
+  void warningSignal (QString msg);
+  void errorSignal (QString msg);
+
+
+protected:
+
+  void run ();
+
+  void progressRange (int32_t stage, int32_t min, int32_t max);
+  void progressValue (int32_t stage, int32_t value);
+  void statusMessage (QString msg);
+  void warningMessage (QString msg);
+  void errorMessage (QString msg);
+
+
+  CONVERT_OPTIONS  options;
+
+  uint8_t          status;
+
+  int32_t          range_max[3];
+
+  QElapsedTimer    timer[3];
+};
+
+#endif
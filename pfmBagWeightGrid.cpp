@@ -0,0 +1,106 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include "pfmBagWeightGrid.hpp"
+
+#include <stdlib.h>
+
+
+
+void 
+clear_weight_grid (WEIGHT_GRID *grid)
+{
+  grid->tiles_wide = grid->tiles_high = grid->tiles_used = 0;
+  grid->tile = NULL;
+}
+
+
+
+//  Allocate the (empty) tile directory for a width by height cell grid.  Returns NVFalse if we're out of memory.
+
+uint8_t 
+init_weight_grid (WEIGHT_GRID *grid, int32_t width, int32_t height)
+{
+  grid->tiles_wide = (width + WEIGHT_TILE_CELLS - 1) >> WEIGHT_TILE_SHIFT;
+  grid->tiles_high = (height + WEIGHT_TILE_CELLS - 1) >> WEIGHT_TILE_SHIFT;
+  grid->tiles_used = 0;
+
+  grid->tile = (uint8_t **) calloc ((size_t) grid->tiles_wide * grid->tiles_high, sizeof (uint8_t *));
+  if (grid->tile == NULL) return (NVFalse);
+
+  return (NVTrue);
+}
+
+
+
+//  Allocate (zeroed) any tiles covering the cells from min_col, min_row to max_col, max_row that aren't already
+//  allocated.  Returns NVFalse if we're out of memory.
+
+uint8_t 
+add_weight_tiles (WEIGHT_GRID *grid, int32_t min_col, int32_t max_col, int32_t min_row, int32_t max_row)
+{
+  for (int32_t i = min_row >> WEIGHT_TILE_SHIFT ; i <= max_row >> WEIGHT_TILE_SHIFT ; i++)
+    {
+      for (int32_t j = min_col >> WEIGHT_TILE_SHIFT ; j <= max_col >> WEIGHT_TILE_SHIFT ; j++)
+        {
+          uint8_t **tile = &grid->tile[i * grid->tiles_wide + j];
+
+          if (*tile == NULL)
+            {
+              *tile = (uint8_t *) calloc (WEIGHT_TILE_CELLS * WEIGHT_TILE_CELLS, sizeof (uint8_t));
+              if (*tile == NULL) return (NVFalse);
+
+              grid->tiles_used++;
+            }
+        }
+    }
+
+  return (NVTrue);
+}
+
+
+
+void 
+free_weight_grid (WEIGHT_GRID *grid)
+{
+  if (grid->tile)
+    {
+      for (int32_t i = 0 ; i < grid->tiles_wide * grid->tiles_high ; i++) free (grid->tile[i]);
+      free (grid->tile);
+    }
+
+  clear_weight_grid (grid);
+}
@@ -0,0 +1,96 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+#ifndef PFMBAGWEIGHTGRID_H
+#define PFMBAGWEIGHTGRID_H
+
+#include <stdtypes.h>
+
+#include "nvutility.h"
+
+
+//  The weight grid is stored in square tiles of WEIGHT_TILE_CELLS (a power of two) cells on a side.
+
+#define WEIGHT_TILE_SHIFT  6
+#define WEIGHT_TILE_CELLS  (1 << WEIGHT_TILE_SHIFT)
+#define WEIGHT_TILE_MASK   (WEIGHT_TILE_CELLS - 1)
+
+
+/*!
+    Sparse storage for the enhanced surface weights.  The grid is split into tiles of WEIGHT_TILE_CELLS by
+    WEIGHT_TILE_CELLS cells and only the tiles that a feature's search radius can reach are allocated (see
+    add_weight_tiles), the rest of the directory (tile) is NULL and those cells have a weight of 0.  tiles_used is the
+    number of tiles that have been allocated.
+*/
+
+typedef struct
+{
+  int32_t                      tiles_wide;
+  int32_t                      tiles_high;
+  int32_t                      tiles_used;
+  uint8_t                      **tile;
+} WEIGHT_GRID;
+
+
+void clear_weight_grid (WEIGHT_GRID *grid);
+uint8_t init_weight_grid (WEIGHT_GRID *grid, int32_t width, int32_t height);
+uint8_t add_weight_tiles (WEIGHT_GRID *grid, int32_t min_col, int32_t max_col, int32_t min_row, int32_t max_row);
+void free_weight_grid (WEIGHT_GRID *grid);
+
+
+//!  The weight of the cell at row, col (0 if its tile wasn't allocated).
+
+inline uint8_t 
+weight_value (WEIGHT_GRID *grid, int32_t row, int32_t col)
+{
+  uint8_t *tile = grid->tile[(row >> WEIGHT_TILE_SHIFT) * grid->tiles_wide + (col >> WEIGHT_TILE_SHIFT)];
+
+  return (tile ? tile[((row & WEIGHT_TILE_MASK) << WEIGHT_TILE_SHIFT) + (col & WEIGHT_TILE_MASK)] : 0);
+}
+
+
+//!  The weight of the cell at row, col for updating.  The cell's tile must have been allocated with add_weight_tiles.
+
+inline uint8_t *
+weight_cell (WEIGHT_GRID *grid, int32_t row, int32_t col)
+{
+  uint8_t *tile = grid->tile[(row >> WEIGHT_TILE_SHIFT) * grid->tiles_wide + (col >> WEIGHT_TILE_SHIFT)];
+
+  return (&tile[((row & WEIGHT_TILE_MASK) << WEIGHT_TILE_SHIFT) + (col & WEIGHT_TILE_MASK)]);
+}
+
+#endif
@@ -123,3 +123,50 @@ runPage::runPage (QWidget *parent, RUN_PROGRESS *prog, QListWidget **cList):
 
   registerField ("progress_gbar*", progress->gbar, "value");
 }
+
+
+
+//  The conversion thread's progress and status signals are connected to these.
+
+QProgressBar *
+runPage::progressBar (int32_t stage)
+{
+  switch (stage)
+    {
+    case WEIGHT_PROGRESS:
+      return (progress->wbar);
+
+    case SURFACE_PROGRESS:
+      return (progress->mbar);
+    }
+
+  return (progress->gbar);
+}
+
+
+
+void 
+runPage::slotProgressRange (int stage, int min, int max)
+{
+  progressBar (stage)->setRange (min, max);
+}
+
+
+
+void 
+runPage::slotProgress (int stage, int value)
+{
+  progressBar (stage)->setValue (value);
+}
+
+
+
+void 
+runPage::slotMessage (QString msg)
+{
+  QListWidgetItem *cur = new QListWidgetItem (msg);
+
+  checkList->addItem (cur);
+  checkList->setCurrentItem (cur);
+  checkList->scrollToItem (cur);
+}
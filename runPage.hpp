@@ -39,7 +39,7 @@
 #ifndef RUNPAGE_H
 #define RUNPAGE_H
 
-#include "pfmBag.hpp"
+#include "pfmBagDef.hpp"
 
 
 class runPage:public QWizardPage
@@ -55,8 +55,18 @@ public:
 signals:
 
 
+public slots:
+
+  void slotProgressRange (int stage, int min, int max);
+  void slotProgress (int stage, int value);
+  void slotMessage (QString msg);
+
+
 protected:
 
+  QProgressBar *progressBar (int32_t stage);
+
+
   RUN_PROGRESS     *progress;
 
   QListWidget      *checkList;
@@ -0,0 +1,83 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#include "pfmBagDef.hpp"
+
+
+//  Copy the conversion settings out of OPTIONS (and the file names that the wizard pages or the command line
+//  gave us) into the structure that the conversion engine uses.
+
+void set_convert_options (OPTIONS *options, QString output_file_name, QString area_file_name, QString sep_file_name,
+                          CONVERT_OPTIONS *op)
+{
+  op->pfm_file_name = options->pfm_file_name;
+  op->output_file_name = output_file_name;
+  op->area_file_name = area_file_name;
+  op->sep_file_name = sep_file_name;
+  op->surface = options->surface;
+  op->mbin_size = options->mbin_size;
+  op->gbin_size = options->gbin_size;
+  op->uncertainty = options->uncertainty;
+  op->enhanced = options->enhanced;
+  op->depth_cor = options->depth_cor;
+  op->v_datum = options->v_datum;
+  op->v_datum_name = options->v_datums[options->v_datum].name;
+  op->pfm_wkt = options->pfm_wkt;
+  op->bag_wkt = options->bag_wkt;
+  op->elev_off = options->elev_off;
+  op->non_radius = options->non_radius;
+  op->source = options->source;
+  op->classification = options->classification;
+  op->authority = options->authority;
+  op->declassDate = options->declassDate;
+  op->distStatement = options->distStatement;
+  op->title = options->title;
+  op->pi_name = options->pi_name;
+  op->pi_title = options->pi_title;
+  op->poc_name = options->poc_name;
+  op->abstract = options->abstract;
+  op->threads = options->threads;
+  op->weight_engine = options->weight_engine;
+  op->approx_error = options->approx_error;
+  op->grid_engine = options->grid_engine;
+  op->depth_cache = options->depth_cache;
+  op->prefetch = options->prefetch;
+  op->cube_fast = options->cube_fast;
+  op->file_hints = options->file_hints;
+  strcpy (op->progname, options->progname);
+}
@@ -400,38 +400,44 @@ void startPage::slotAreaFileBrowse ()
                     }
                   else
                     {
-                      //  Read only the first shape.
+                      //  All of the shapes (and all of their parts) are used for the area so check them all.
 
-                      shape = SHPReadObject (shpHandle, 0);
+                      int32_t vertices = 0;
 
-
-                      //  Check the number of vertices.
-
-                      if (shape->nVertices < 3)
+                      for (int32_t i = 0 ; i < numShapes ; i++)
                         {
-                          SHPClose (shpHandle);
-                          QMessageBox::warning (this, tr ("pfmBag"), tr ("Number of vertices (%1) of shape file %2 is too few for a polygon!").arg
-                                                (shape->nVertices).arg (area_file_name));
-                          return;
-                        }
+                          if ((shape = SHPReadObject (shpHandle, i)) == NULL) continue;
 
 
-                      //  Read the vertices to take a shot at determining that this is a geographic polygon.
+                          //  Read the vertices to take a shot at determining that this is a geographic polygon.
 
-                      for (int32_t j = 0 ; j < shape->nVertices ; j++)
-                        {
-                          if (shape->padfX[j] < -360.0 || shape->padfX[j] > 360.0 || shape->padfY[j] < -90.0 || shape->padfY[j] > 90.0)
+                          for (int32_t j = 0 ; j < shape->nVertices ; j++)
                             {
-                              SHPDestroyObject (shape);
-                              SHPClose (shpHandle);
-                              QMessageBox::warning (this, tr ("pfmBag"), tr ("Shape file %1 does not appear to be geographic!").arg (area_file_name));
-                              return;
+                              if (shape->padfX[j] < -360.0 || shape->padfX[j] > 360.0 || shape->padfY[j] < -90.0 || shape->padfY[j] > 90.0)
+                                {
+                                  SHPDestroyObject (shape);
+                                  SHPClose (shpHandle);
+                                  QMessageBox::warning (this, tr ("pfmBag"), tr ("Shape file %1 does not appear to be geographic!").arg (area_file_name));
+                                  return;
+                                }
                             }
-                        }
 
+                          vertices += shape->nVertices;
+
+                          SHPDestroyObject (shape);
+                        }
 
-                      SHPDestroyObject (shape);
                       SHPClose (shpHandle);
+
+
+                      //  Check the number of vertices.
+
+                      if (vertices < 3)
+                        {
+                          QMessageBox::warning (this, tr ("pfmBag"), tr ("Number of vertices (%1) of shape file %2 is too few for a polygon!").arg
+                                                (vertices).arg (area_file_name));
+                          return;
+                        }
                     }
                 }
             }
@@ -0,0 +1,18 @@
+######################################################################
+# Standalone check of the pfmFeature remarks parser (pfmBagRemarks).
+# Build and run with:  qmake && make && ./tst_remarks
+######################################################################
+
+TEMPLATE = app
+TARGET = tst_remarks
+CONFIG += console
+CONFIG -= app_bundle
+QT -= gui
+DEPENDPATH += . ../..
+INCLUDEPATH += . ../.. $$(PFM_INCLUDE)
+DEFINES += SRCDIR=\\\"$$PWD/\\\"
+
+# Input
+HEADERS += ../../pfmBagRemarks.hpp
+SOURCES += tst_remarks.cpp \
+           ../../pfmBagRemarks.cpp
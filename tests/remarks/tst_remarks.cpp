@@ -0,0 +1,181 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+/*!
+    Standalone check of feature_radius (pfmBagRemarks) against the QString::section/toDouble parsing that it replaced.
+    Each line of remarks.txt (or the file named on the command line) is a radius and a feature remarks string
+    separated by a tab.  Every remarks string is run through feature_radius and through the old QString code, and both
+    have to match the radius bit for bit.  It's done in the C locale and again in a locale with a comma decimal point
+    (if one is installed) since feature_radius converts with strtod.  The exit status is the number of failures.
+
+    To build and run it:  qmake && make && ./tst_remarks
+*/
+
+#include <QtCore>
+
+#include <stdio.h>
+#include <string.h>
+#include <locale.h>
+#include <math.h>
+
+#include "pfmBagRemarks.hpp"
+
+
+#define NON_RADIUS 5.0
+
+
+//  The QString version of feature_radius from before pfmBagRemarks (pfmBagEngine::featureRadius).
+
+static double 
+qstring_radius (const char *feature_remarks, double non_radius)
+{
+  QString remarks = QString (feature_remarks);
+  double radius;
+
+
+  if (remarks.contains ("pfmFeature") && remarks.contains (", bin size "))
+    {
+      if (remarks.contains (", max dist "))
+        {
+          radius = remarks.section (',', 6, 6).section (' ', 3, 3).toDouble ();
+
+          radius += (remarks.section (',', 4, 4).section ('/', 1, 1).section (' ', 1, 1).toDouble ());
+        }
+      else
+        {
+          double bin_size = remarks.section (',', 2, 2).section (' ', 3, 3).toDouble ();
+          double half = bin_size / 2.0L;
+          double two_thirds = bin_size * 2.0L / 3.0L;
+          double half_square = half * half;
+          double two_thirds_square = two_thirds * two_thirds;
+          radius = sqrt (half_square + half_square) + sqrt (two_thirds_square + two_thirds_square);
+
+          radius += (remarks.section (',', 4, 4).section ('/', 1, 1).section (' ', 1, 1).toDouble ());
+        }
+    }
+  else
+    {
+      radius = non_radius;
+    }
+
+  return (radius);
+}
+
+
+
+//  Run every case, returns the number of failures.
+
+static int32_t 
+check (QList<double> &expected, QList<QByteArray> &remarks, const char *locale_name)
+{
+  int32_t failures = 0;
+
+
+  for (int32_t i = 0 ; i < remarks.size () ; i++)
+    {
+      double radius = feature_radius (remarks[i].constData (), NON_RADIUS);
+      double qradius = qstring_radius (remarks[i].constData (), NON_RADIUS);
+
+      if (memcmp (&radius, &expected[i], sizeof (double)) || memcmp (&qradius, &expected[i], sizeof (double)))
+        {
+          fprintf (stderr, "FAIL (%s locale): %s\n    expected %.17g, feature_radius %.17g, QString %.17g\n", locale_name,
+                   remarks[i].constData (), expected[i], radius, qradius);
+          failures++;
+        }
+    }
+
+  printf ("%s locale: %d of %d cases passed\n", locale_name, remarks.size () - failures, remarks.size ());
+
+  return (failures);
+}
+
+
+
+int 
+main (int argc, char **argv)
+{
+  QFile file (argc > 1 ? QString (argv[1]) : QString (SRCDIR "remarks.txt"));
+  QList<double> expected;
+  QList<QByteArray> remarks;
+
+
+  if (!file.open (QIODevice::ReadOnly))
+    {
+      fprintf (stderr, "Unable to open %s\n", file.fileName ().toLocal8Bit ().constData ());
+      return (-1);
+    }
+
+  while (!file.atEnd ())
+    {
+      QByteArray line = file.readLine ();
+
+      if (line.endsWith ('\n')) line.chop (1);
+
+      int32_t tab = line.indexOf ('\t');
+
+      if (line.isEmpty () || line.startsWith ('#') || tab < 0) continue;
+
+      expected.append (line.left (tab).toDouble ());
+      remarks.append (line.mid (tab + 1));
+    }
+
+  file.close ();
+
+
+  int32_t failures = check (expected, remarks, "C");
+
+
+  //  Again with a comma decimal point.  QString::toDouble always uses the C locale, feature_radius has to as well.
+
+  const char *comma_locale[] = {"de_DE.UTF-8", "de_DE.utf8", "de_DE", "fr_FR.UTF-8", "fr_FR.utf8", "fr_FR", NULL};
+  bool tried = false;
+
+  for (int32_t i = 0 ; comma_locale[i] && !tried ; i++)
+    {
+      if (setlocale (LC_NUMERIC, comma_locale[i]) && localeconv ()->decimal_point[0] == ',')
+        {
+          failures += check (expected, remarks, comma_locale[i]);
+          tried = true;
+        }
+    }
+
+  setlocale (LC_NUMERIC, "C");
+
+  if (!tried) printf ("No comma decimal point locale is installed, skipped the locale check\n");
+
+
+  return (failures);
+}
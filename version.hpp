@@ -39,7 +39,7 @@
 
 #ifndef VERSION
 
-#define     VERSION     "PFM Software - pfmBag V4.22 - 08/07/19"
+#define     VERSION     "PFM Software - pfmBag V5.00 - 10/17/26"
 
 #endif
 
@@ -480,4 +480,99 @@
   - Now that get_area_mbr supports shape files we don't need to handle it differently from the other
     area file types.
 
+
+  Version 5.00
+  PFM Software
+  10/17/26
+
+  - Moved the actual PFM to BAG conversion out of pfmBag::slotCustomButtonClicked and into the GUI free pfmBagEngine
+    class.  The engine reports progress, status, and errors through the pfmBagCallback interface so the wizard is now
+    just one of its possible front ends.
+  - Fixed the CHRTR2 separation file being opened before the file name was set and the UTM conversion of the
+    separation surface positions overwriting X with Y.
+  - Added a command line (batch) mode.  If the first argument is a long option (e.g. pfmBag --pfm x.pfm --bag y.bag)
+    the wizard isn't started and the conversion is run using the pfmBag.ini defaults overridden by the command line
+    options.  Run pfmBag --help for the options.
+  - The wizard now runs the conversion in a separate thread (pfmBagThread).  Progress is sent to the run page at
+    most 10 times per second and the GUI no longer has to process events for every output cell.
+  - Added multi-threaded gridding.  Bands of rows are gridded by a pool of threads (pfmBagGridThread), each with its
+    own PFM handle and proj4 projections, and written to the BAG in row order by the engine.  The number of threads
+    is set with --threads in batch mode (or "gridding threads" in pfmBag.ini), 0 uses one per processor.
+  - The enhanced surface weight computation now uses a bucket index of the features (FEATURE_BUCKET_CELLS square
+    buckets of BAG cells) so each cell only checks the features whose search radius can reach it instead of every
+    feature in the feature file.  The weights are the same as before.
+  - Added an alternative, feature centric, enhanced surface weight engine that splats each feature's search radius
+    onto the weight grid (--weights splat or "weight engine" 1 in pfmBag.ini).  It is much faster when the features
+    are sparse but, since it rounds each feature's contribution, the weights can differ by one from the default
+    (gather) engine.
+  - The positions of the features that are used are now computed in the BAG CRS once (projectFeatures) and reused
+    by the weight computation, the tracking list, and the modified nodes instead of being re-projected for every
+    BAG cell.
+  - For UTM output the cell corners used to find the covering PFM cells are now transformed a whole row boundary
+    (bag_width + 1 points) at a time with a single pj_transform call, and each gridding context keeps the previous
+    row's upper boundary for the next row.  That's one transformed point per cell instead of two.
+  - Added an approximate cell corner transform for UTM output (--approx-error METERS or "approximate transform error"
+    in pfmBag.ini, 0 for exact).  Each row of corners is transformed exactly at a few points and interpolated in
+    between, splitting the row until the interpolation error is less than the allowed error.  The largest estimated
+    error is reported in the process status list.
+  - Added a scatter gridding engine (--gridding scatter or "gridding engine" 1 in pfmBag.ini).  Instead of reading
+    every PFM cell that covers each BAG cell it reads each PFM cell's depth array once per band of rows and adds the
+    soundings to the statistics of the BAG cells they fall in.  Much faster when the BAG cells are smaller than (or
+    not aligned with) the PFM cells.  Not used for CUBE surfaces.
+  - The gather gridding engine now reads the PFM depth arrays through a least recently used cache
+    (pfmBagDepthCache) so adjacent BAG cells that share a PFM cell don't each read it.  The size of each gridding
+    thread's cache is set with --depth-cache MB (or "depth cache size" in pfmBag.ini, default 64, 0 to disable).
+    The hit and miss counts are reported in the process status list.
+  - Added a read ahead thread (pfmBagPrefetchThread) for the gather gridding engine.  While a BAG row is being
+    gridded it reads the depth arrays of the PFM rows that cover the next few BAG rows (--prefetch ROWS or
+    "prefetch rows" in pfmBag.ini, default 2, 0 to disable) using its own PFM handle, and the depth array cache
+    takes them from its ready buffer instead of reading them.
+  - The depth array cache and the read ahead buffer now use grow-only arrays (an open addressing hash table and a
+    ring of row slots) that are reused instead of allocating bookkeeping for every PFM cell read.
+  - Added a CUBE fast mode (--cube-fast or "cube fast flag" in pfmBag.ini).  The number of soundings comes from the
+    PFM bin record and the depth array is only read for enhanced surface cells with a non-zero weight (where the
+    uncertainty of the minimum depth is needed).
+  - The gather gridding engine now decodes each depth array into arrays of X, Y, Z, and vertical error plus a
+    validity bitmask (pfmBagSoundings) and filters and accumulates the soundings with an AVX2 or NEON kernel when the
+    processor has one (scalar otherwise).  The kernel used is reported in the process status list.  The sums are
+    added in sounding order so the results are the same whichever kernel is used.  The depth array cache and the
+    read ahead thread keep the arrays decoded so each one is only decoded once however many BAG cells use it.
+  - Added PFM file read ahead hints (--file-hints or "file hints flag" in pfmBag.ini, off by default).  The bin and
+    depth files named in the PFM list file are opened (read only) and, as each band of rows is started, the kernel
+    is asked to read the part of the bin file that covers it and the next band.  The depth file is requested in full
+    if it's less than a quarter of physical memory.  libpfm still does the reading.  No effect on Windows.
+  - Added a pool of read only PFM handles (pfmBagHandlePool).  The gridding and read ahead threads lease their PFM
+    handles from it instead of each opening (and closing) the PFM, the opens are serialized, and the handles are
+    reused for the rest of the conversion.
+  - When an area file is used, the area polygon (not just its bounding rectangle) now limits what is gridded.  The
+    polygon is rasterized once into spans of inside cells for each BAG row and cells that don't touch it are written
+    as NULL without reading the PFM (the read ahead thread only reads the PFM columns that cover the inside spans).
+  - Area polygons no longer have a 200 vertex limit.  Shape files use every part of every shape (so multi-part areas
+    and holes work) and the .ARE, .are, and .afs files can have any number of vertices.
+  - The features used in the BAG are selected (and projected, and given their enhanced surface search radius) once
+    into a table that the weights, lineage, tracking list, and modified nodes all use.  Fixed the lineage process
+    steps, which didn't line up with the tracking list items' list_series when some features weren't used.
+  - The enhanced surface search radius is now parsed from the pfmFeature remarks (pfmBagRemarks) in a single pass
+    over the remarks without building any temporary strings.
+  - For geographic BAGs the enhanced surface weights now use a local tangent plane distance (pfmBagGeoDistance) with
+    WGS-84 meters per degree precomputed for each row instead of the ellipsoidal distance for every cell/feature pair.
+    The ellipsoidal distance is still used when the approximation might be off by more than 0.01 percent (very large
+    radii or near the poles), so a weight can only change when a distance is within 0.01 percent of a weight step.
+  - The enhanced surface weights are computed in bands of rows by the same number of threads as the gridding
+    (pfmBagWeightThread).  Each band only writes its own rows so the weights are the same as with one thread.
+  - The enhanced surface weight grid is now sparse (pfmBagWeightGrid).  It's stored in 64 by 64 cell tiles and only
+    the tiles that a feature's search radius can reach are allocated.  The number of tiles used is reported in the
+    process status list.
+  - The engine leases the gridding, read ahead, and weight thread PFM handles without waiting so it reports an error
+    instead of hanging if the handle pool is empty, and limits the number of threads to what the pool can supply.
+  - Added a standalone test of the pfmFeature remarks parser (tests/remarks, qmake && make && ./tst_remarks).  It
+    checks feature_radius and the QString::section/toDouble code it replaced against a checked in set of remarks,
+    including malformed numbers, missing sections, and comma decimal points, in the C locale and in a comma decimal
+    point locale.  Numbers are rewritten as their significant digits and an exponent in a fixed size buffer, so any
+    length of number is converted (as QString::toDouble does) without allocating or using the locale's decimal point.
+  - For UTM output the area polygon's lat/lon edges are densified before they're rasterized so the projected edges
+    are within half a cell of the rasterized ones (long edges used to curve by more than the one cell margin and
+    cells inside the area were written as NULL).  The scatter engine's margin around each band is now measured from
+    how far the band's edges bow out between the cell corners instead of being fixed at one PFM cell.
+
 </pre>*/